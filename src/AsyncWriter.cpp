@@ -0,0 +1,215 @@
+#include "AsyncWriter.h"
+
+#include "FileUtils.h"
+#include "H5Cpp.h"
+#include "Helpers.h"
+
+#include <exception>
+#include <utility>
+
+namespace
+{
+
+// number of error messages kept until they are retrieved
+const std::size_t MAX_ERRORS = 100;
+
+} // anonymous namespace
+
+AsyncWriter::~AsyncWriter()
+{
+  Stop();
+}
+
+std::size_t AsyncWriter::Enqueue(const std::string &fileName, Job job)
+{
+  auto key = GetCanonicalPath(fileName);
+
+  std::lock_guard<std::mutex> lock(m_queueMutex);
+
+  m_jobs.push_back(Entry{std::move(key), std::move(job)});
+
+  if(!m_thread.joinable())
+  {
+    m_stop   = false;
+    m_thread = std::thread(&AsyncWriter::Run, this);
+  }
+
+  m_queueCondition.notify_all();
+
+  return m_jobs.size();
+}
+
+void AsyncWriter::RunPending()
+{
+  std::unique_lock<std::mutex> lock(m_queueMutex);
+
+  for(;;)
+  {
+    auto it = m_jobs.end();
+    m_queueCondition.wait(lock, [this, &it] {
+      it = FindRunnable(nullptr);
+      return it != m_jobs.end() || (m_jobs.empty() && m_runningFiles.empty());
+    });
+
+    if(it == m_jobs.end())
+    {
+      return;
+    }
+
+    RunEntry(lock, it);
+  }
+}
+
+void AsyncWriter::RunPending(const std::string &fileName)
+{
+  const auto key = GetCanonicalPath(fileName);
+
+  std::unique_lock<std::mutex> lock(m_queueMutex);
+
+  for(;;)
+  {
+    // a running job of the file goes before the queued ones
+    m_queueCondition.wait(lock, [this, &key] { return m_runningFiles.count(key) == 0; });
+
+    auto it = FindRunnable(&key);
+    if(it == m_jobs.end())
+    {
+      return;
+    }
+
+    RunEntry(lock, it);
+  }
+}
+
+void AsyncWriter::Stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    m_stop = true;
+  }
+  m_queueCondition.notify_all();
+
+  if(m_thread.joinable())
+  {
+    m_thread.join();
+  }
+}
+
+std::size_t AsyncWriter::GetNumPending() const
+{
+  std::lock_guard<std::mutex> lock(m_queueMutex);
+
+  return m_jobs.size();
+}
+
+void AsyncWriter::AddError(std::string error)
+{
+  std::lock_guard<std::mutex> lock(m_queueMutex);
+
+  if(m_errors.size() < MAX_ERRORS)
+  {
+    m_errors.push_back(std::move(error));
+  }
+  else
+  {
+    m_numDroppedErrors++;
+  }
+}
+
+std::vector<std::string> AsyncWriter::TakeErrors()
+{
+  std::lock_guard<std::mutex> lock(m_queueMutex);
+
+  auto errors = std::move(m_errors);
+  m_errors.clear();
+
+  if(m_numDroppedErrors > 0)
+  {
+    errors.push_back("{} more errors were dropped."_format(m_numDroppedErrors));
+    m_numDroppedErrors = 0;
+  }
+
+  return errors;
+}
+
+std::size_t AsyncWriter::GetNumErrors() const
+{
+  std::lock_guard<std::mutex> lock(m_queueMutex);
+
+  return m_errors.size() + m_numDroppedErrors;
+}
+
+void AsyncWriter::Run()
+{
+  std::unique_lock<std::mutex> lock(m_queueMutex);
+
+  for(;;)
+  {
+    auto it = m_jobs.end();
+    m_queueCondition.wait(lock, [this, &it] {
+      it = FindRunnable(nullptr);
+      return m_stop || it != m_jobs.end();
+    });
+    if(m_stop)
+    {
+      return;
+    }
+
+    RunEntry(lock, it);
+  }
+}
+
+void AsyncWriter::RunJob(const Job &job)
+{
+  std::string error;
+
+  try
+  {
+    job();
+    return;
+  }
+  catch(H5::Exception const &ex)
+  {
+    error = ex.getCDetailMsg();
+  }
+  catch(std::exception const &ex)
+  {
+    error = ex.what();
+  }
+  catch(...)
+  {
+    error = "Unknown error.";
+  }
+
+  AddError(std::move(error));
+}
+
+AsyncWriter::EntryIterator AsyncWriter::FindRunnable(const std::string *key)
+{
+  // only the first job of a file may run, which keeps the order of its writes
+  std::set<std::string> blocked = m_runningFiles;
+  for(auto it = m_jobs.begin(); it != m_jobs.end(); ++it)
+  {
+    if(blocked.count(it->key) == 0 && (key == nullptr || it->key == *key))
+    {
+      return it;
+    }
+    blocked.insert(it->key);
+  }
+
+  return m_jobs.end();
+}
+
+void AsyncWriter::RunEntry(std::unique_lock<std::mutex> &lock, EntryIterator it)
+{
+  auto entry = std::move(*it);
+  m_jobs.erase(it);
+  m_runningFiles.insert(entry.key);
+
+  lock.unlock();
+  RunJob(entry.job);
+  lock.lock();
+
+  m_runningFiles.erase(entry.key);
+  m_queueCondition.notify_all();
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// @brief Queue of write jobs executed by a background thread
+///
+/// Enqueue() only touches the queue and returns immediately. The writer
+/// thread runs the jobs in order, one at a time. Jobs take the locks of the
+/// files they write to themselves.
+///
+/// Every job belongs to a file. Any thread can run the remaining jobs of a
+/// file itself with RunPending(fileName), e.g. to make earlier asynchronous
+/// writes visible to a read, without running the jobs of other files. Only
+/// one job per file runs at a time and always the first queued one, so the
+/// order of the jobs of a file is kept no matter which thread runs them,
+/// while jobs of different files run in parallel. RunPending() must not be
+/// called while holding a lock which a job needs, i.e. a file lock.
+///
+/// Jobs report failure by throwing, the error messages are collected and can
+/// be retrieved with TakeErrors().
+class AsyncWriter
+{
+public:
+  using Job = std::function<void()>;
+
+  AsyncWriter() = default;
+  ~AsyncWriter();
+
+  AsyncWriter(const AsyncWriter &) = delete;
+  AsyncWriter &operator=(const AsyncWriter &) = delete;
+
+  /// Queue a job writing to `fileName`, starts the writer thread if necessary
+  ///
+  /// @return number of queued jobs
+  std::size_t Enqueue(const std::string &fileName, Job job);
+
+  /// Run all queued jobs on the calling thread, waits for a job run by the writer thread
+  void RunPending();
+
+  /// Run the queued jobs of the file on the calling thread, waits for a job run by the writer thread
+  void RunPending(const std::string &fileName);
+
+  /// Stop the writer thread after the current job
+  ///
+  /// Jobs still queued are kept and run by RunPending() or a restarted writer thread.
+  void Stop();
+
+  std::size_t GetNumPending() const;
+
+  /// Record the error of a write done outside of a job, returned by TakeErrors() like the errors of jobs
+  void AddError(std::string error);
+
+  /// Return and remove the error messages of failed jobs
+  std::vector<std::string> TakeErrors();
+
+  std::size_t GetNumErrors() const;
+
+private:
+  void Run();
+
+  /// Run a job and record its error, the queue mutex must not be held
+  void RunJob(const Job &job);
+
+  /// Queued job and the canonical path of its file
+  struct Entry
+  {
+    std::string key;
+    Job job;
+  };
+
+  using EntryIterator = std::deque<Entry>::iterator;
+
+  /// Return the first job whose file has no running job, of the file `key` if given
+  EntryIterator FindRunnable(const std::string *key);
+
+  /// Take the job from the queue and run it with `lock` on the queue mutex released meanwhile
+  void RunEntry(std::unique_lock<std::mutex> &lock, EntryIterator it);
+
+  mutable std::mutex m_queueMutex;
+  std::condition_variable m_queueCondition;
+  std::deque<Entry> m_jobs;
+  std::set<std::string> m_runningFiles; ///< canonical paths of the files with a running job
+  std::vector<std::string> m_errors;
+  std::size_t m_numDroppedErrors = 0;
+  bool m_stop                    = false;
+  std::thread m_thread;
+};
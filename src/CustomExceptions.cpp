@@ -2,6 +2,7 @@
 
 #include <utility>
 
+#include "CompoundEngine.h"
 #include "Helpers.h"
 
 IgorException::IgorException() : m_errorCode(EXIT_FAILURE)
@@ -61,3 +62,24 @@ int HandleException(const std::exception &e)
 
   return CPP_EXCEPTION;
 }
+
+int HandleException(const CompoundEngine::CompoundError &e, bool quiet)
+{
+  using Kind = CompoundEngine::CompoundError::Kind;
+
+  int errorCode = ERR_HDF5;
+  switch(e.GetKind())
+  {
+  case Kind::InvalidType:
+    errorCode = ERR_INVALID_TYPE;
+    break;
+  case Kind::OutOfRange:
+    errorCode = kParameterOutOfRange;
+    break;
+  case Kind::HDF5:
+    errorCode = ERR_HDF5;
+    break;
+  }
+
+  return IgorException(errorCode, e.what()).HandleException(quiet);
+}
@@ -3,6 +3,11 @@
 #include <exception>
 #include <string>
 
+namespace CompoundEngine
+{
+class CompoundError;
+}
+
 class IgorException : public std::exception
 {
 public:
@@ -34,3 +39,6 @@ int HandleException(const IgorException &e);
 
 /// @brief Handler allows to suppress output to Igor History when quiet = true
 int HandleException(const IgorException &e, bool quiet);
+
+/// @brief Handler for errors of the compound engine, maps them to the error codes of this XOP
+int HandleException(const CompoundEngine::CompoundError &e, bool quiet);
@@ -0,0 +1,34 @@
+#include "FileLocks.h"
+#include "FileUtils.h"
+
+#include <utility>
+
+FileLocks::Guard::Guard(std::shared_ptr<std::recursive_mutex> mutex) : m_mutex(std::move(mutex)), m_lock(*m_mutex)
+{
+}
+
+FileLocks::Guard FileLocks::Lock(const std::string &fileName)
+{
+  const auto key = GetCanonicalPath(fileName);
+
+  std::shared_ptr<std::recursive_mutex> mutex;
+  {
+    std::lock_guard<std::mutex> lock(m_mapMutex);
+
+    for(auto it = m_mutexes.begin(); it != m_mutexes.end();)
+    {
+      it = it->second.expired() ? m_mutexes.erase(it) : std::next(it);
+    }
+
+    auto &entry = m_mutexes[key];
+    mutex       = entry.lock();
+    if(!mutex)
+    {
+      mutex = std::make_shared<std::recursive_mutex>();
+      entry = mutex;
+    }
+  }
+
+  // blocking must happen without holding the map mutex
+  return Guard(std::move(mutex));
+}
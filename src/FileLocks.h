@@ -0,0 +1,34 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/// @brief One mutex per file, so that operations on different files do not block each other
+///
+/// Files are keyed by their canonical path. The mutexes are recursive, so a
+/// thread holding the lock of a file can lock it again, e.g. when flushing
+/// buffered rows of that file. Mutexes of files which are not locked by any
+/// thread are removed on the next Lock().
+class FileLocks
+{
+public:
+  /// Lock of a single file, unlocks when destroyed
+  class Guard
+  {
+  public:
+    explicit Guard(std::shared_ptr<std::recursive_mutex> mutex);
+
+  private:
+    std::shared_ptr<std::recursive_mutex> m_mutex;
+    std::unique_lock<std::recursive_mutex> m_lock;
+  };
+
+  /// Lock the file, blocks until no other thread holds its lock
+  Guard Lock(const std::string &fileName);
+
+private:
+  std::mutex m_mapMutex;
+  std::map<std::string, std::weak_ptr<std::recursive_mutex>> m_mutexes;
+};
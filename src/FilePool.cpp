@@ -0,0 +1,311 @@
+#include "FilePool.h"
+#include "FileUtils.h"
+
+#include <algorithm>
+#include <exception>
+
+namespace
+{
+
+// growth step of the memory image of files opened with the core driver
+const size_t CORE_DRIVER_INCREMENT = 4 * 1024 * 1024;
+
+// granularity of the dirty regions written on flush, avoids writing the whole image
+const size_t CORE_DRIVER_PAGE_SIZE = 64 * 1024;
+
+unsigned int GetAccessFlags(FilePool::Mode mode)
+{
+  return mode == FilePool::Mode::ReadWrite ? H5F_ACC_RDWR : H5F_ACC_RDONLY;
+}
+
+} // anonymous namespace
+
+std::shared_ptr<H5::H5File> FilePool::Find(const std::string &fileName, Mode mode, bool &inMemory)
+{
+  inMemory = false;
+  if(m_capacity == 0)
+  {
+    return nullptr;
+  }
+
+  CloseIdle();
+  EvictExcessMemory();
+
+  auto it = m_files.find(GetCanonicalPath(fileName));
+  if(it != m_files.end() && mode == Mode::ReadWrite && it->second.mode == Mode::ReadOnly)
+  {
+    CloseEntry(it);
+    it = m_files.end();
+  }
+
+  if(it == m_files.end())
+  {
+    inMemory = m_inMemory && mode == Mode::ReadWrite && FitsInMemory(fileName);
+    return nullptr;
+  }
+
+  it->second.lastUsed = Clock::now();
+
+  return it->second.file;
+}
+
+std::shared_ptr<H5::H5File> FilePool::Add(const std::string &fileName, Mode mode, bool inMemory,
+                                          std::shared_ptr<H5::H5File> file)
+{
+  if(m_capacity == 0)
+  {
+    return file;
+  }
+
+  const auto key = GetCanonicalPath(fileName);
+  auto it        = m_files.find(key);
+  if(it != m_files.end())
+  {
+    if(mode == Mode::ReadOnly || it->second.mode == Mode::ReadWrite)
+    {
+      m_closedFiles.push_back(std::move(file));
+      it->second.lastUsed = Clock::now();
+      return it->second.file;
+    }
+
+    CloseEntry(it);
+  }
+
+  it = m_files.emplace(key, Entry{std::move(file), mode, Clock::now(), inMemory}).first;
+  auto pooled = it->second.file;
+  EvictExcess();
+
+  return pooled;
+}
+
+void FilePool::Close(const std::string &fileName)
+{
+  auto it = m_files.find(GetCanonicalPath(fileName));
+  if(it != m_files.end())
+  {
+    CloseEntry(it);
+  }
+}
+
+void FilePool::CloseAll()
+{
+  while(!m_files.empty())
+  {
+    CloseEntry(m_files.begin());
+  }
+}
+
+FilePool::Files FilePool::TakeClosedFiles()
+{
+  auto files = std::move(m_closedFiles);
+  m_closedFiles.clear();
+
+  return files;
+}
+
+void FilePool::CloseFiles(Files files)
+{
+  // close all files even if one fails, the first error is reported
+  std::exception_ptr firstError;
+  for(auto &file : files)
+  {
+    try
+    {
+      if(file.use_count() == 1)
+      {
+        file->close();
+      }
+    }
+    catch(...)
+    {
+      if(!firstError)
+      {
+        firstError = std::current_exception();
+      }
+    }
+    file.reset();
+  }
+
+  if(firstError)
+  {
+    std::rethrow_exception(firstError);
+  }
+}
+
+std::shared_ptr<H5::H5File> FilePool::GetWritable(const std::string &fileName) const
+{
+  auto it = m_files.find(GetCanonicalPath(fileName));
+  if(it == m_files.end() || it->second.mode != Mode::ReadWrite)
+  {
+    return nullptr;
+  }
+
+  return it->second.file;
+}
+
+std::vector<std::string> FilePool::GetFileNames() const
+{
+  std::vector<std::string> fileNames;
+  fileNames.reserve(m_files.size());
+  for(const auto &elem : m_files)
+  {
+    fileNames.push_back(elem.first);
+  }
+
+  return fileNames;
+}
+
+hsize_t FilePool::GetMemoryUsage() const
+{
+  hsize_t usage = 0;
+  for(const auto &elem : m_files)
+  {
+    if(elem.second.inMemory)
+    {
+      usage += elem.second.file->getFileSize();
+    }
+  }
+
+  return usage;
+}
+
+void FilePool::CloseIdle()
+{
+  const auto now = Clock::now();
+  for(auto it = m_files.begin(); it != m_files.end();)
+  {
+    auto next = std::next(it);
+    if(now - it->second.lastUsed > m_idleTimeout)
+    {
+      CloseEntry(it);
+    }
+    it = next;
+  }
+}
+
+void FilePool::SetCapacity(std::size_t capacity)
+{
+  m_capacity = capacity;
+  EvictExcess();
+}
+
+void FilePool::SetIdleTimeout(std::chrono::milliseconds timeout)
+{
+  m_idleTimeout = timeout;
+}
+
+void FilePool::SetInMemory(bool inMemory)
+{
+  m_inMemory = inMemory;
+  if(inMemory)
+  {
+    return;
+  }
+
+  for(auto it = m_files.begin(); it != m_files.end();)
+  {
+    auto next = std::next(it);
+    if(it->second.inMemory)
+    {
+      CloseEntry(it);
+    }
+    it = next;
+  }
+}
+
+void FilePool::SetMemoryLimit(hsize_t limit)
+{
+  m_memoryLimit = limit;
+  EvictExcessMemory();
+}
+
+std::size_t FilePool::GetCapacity() const
+{
+  return m_capacity;
+}
+
+std::chrono::milliseconds FilePool::GetIdleTimeout() const
+{
+  return m_idleTimeout;
+}
+
+bool FilePool::GetInMemory() const
+{
+  return m_inMemory;
+}
+
+hsize_t FilePool::GetMemoryLimit() const
+{
+  return m_memoryLimit;
+}
+
+std::shared_ptr<H5::H5File> FilePool::OpenFile(const std::string &fileName, Mode mode, bool inMemory)
+{
+  if(!inMemory)
+  {
+    return std::make_shared<H5::H5File>(fileName, GetAccessFlags(mode));
+  }
+
+  H5::FileAccPropList fapl;
+  fapl.setCore(CORE_DRIVER_INCREMENT, true);
+  if(H5Pset_core_write_tracking(fapl.getId(), true, CORE_DRIVER_PAGE_SIZE) < 0)
+  {
+    throw H5::PropListIException("FilePool::OpenFile", "H5Pset_core_write_tracking failed");
+  }
+
+  return std::make_shared<H5::H5File>(fileName, GetAccessFlags(mode), H5::FileCreatPropList::DEFAULT, fapl);
+}
+
+bool FilePool::FitsInMemory(const std::string &fileName) const
+{
+  FileStamp stamp;
+  if(!GetFileStamp(fileName, stamp))
+  {
+    return false;
+  }
+
+  return static_cast<hsize_t>(stamp.size) + GetMemoryUsage() <= m_memoryLimit;
+}
+
+void FilePool::CloseEntry(std::map<std::string, Entry>::iterator it)
+{
+  m_closedFiles.push_back(std::move(it->second.file));
+  m_files.erase(it);
+}
+
+void FilePool::EvictExcess()
+{
+  while(m_files.size() > m_capacity)
+  {
+    auto lru = std::min_element(m_files.begin(), m_files.end(), [](const auto &a, const auto &b) {
+      return a.second.lastUsed < b.second.lastUsed;
+    });
+    CloseEntry(lru);
+  }
+}
+
+void FilePool::EvictExcessMemory()
+{
+  // closing writes the image to disk, the next Find() of the file decides anew where it lives
+  for(auto usage = GetMemoryUsage(); usage > m_memoryLimit; usage = GetMemoryUsage())
+  {
+    auto largest        = m_files.end();
+    hsize_t largestSize = 0;
+    for(auto it = m_files.begin(); it != m_files.end(); ++it)
+    {
+      if(!it->second.inMemory)
+      {
+        continue;
+      }
+
+      const auto size = it->second.file->getFileSize();
+      if(largest == m_files.end() || size > largestSize)
+      {
+        largest     = it;
+        largestSize = size;
+      }
+    }
+
+    CloseEntry(largest);
+  }
+}
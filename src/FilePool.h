@@ -0,0 +1,128 @@
+#pragma once
+
+#include "H5Cpp.h"
+
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+/// @brief Pool of open HDF5 files shared across operation calls
+///
+/// Keeping files open avoids re-reading the superblock and root group and
+/// keeps the HDF5 metadata cache warm for repeated small appends.
+///
+/// Files are keyed by their canonical path. A file open for read/write also
+/// serves read-only requests, a read/write request for a file pooled
+/// read-only reopens it, as HDF5 does not allow opening the same file twice
+/// with different access modes.
+///
+/// The least recently used file is closed when the capacity is exceeded and
+/// files unused for longer than the idle timeout are closed by CloseIdle().
+/// A capacity of zero disables pooling, Find() never returns a file and the
+/// caller's file is closed when the last reference to it is dropped.
+///
+/// The pool itself is not thread-safe and never opens or closes files
+/// itself, so that the lock guarding it is not held during slow file I/O:
+/// Find() and Add() enclose opening a file with OpenFile(), and files removed
+/// from the pool are handed out by TakeClosedFiles() and closed by the caller
+/// with CloseFiles(). A file still referenced by a caller is closed when the
+/// last reference is dropped.
+///
+/// In memory mode files opened for read/write use the HDF5 core driver with
+/// a backing store. All writes go to an image in RAM, which is written to
+/// disk when the file is flushed or closed. When the images of all pooled
+/// files exceed the memory limit the largest ones are closed, and files which
+/// do not fit anymore are opened on disk again. As unpooled files would be
+/// read and written as a whole on every open, they never use the core driver.
+class FilePool
+{
+public:
+  enum class Mode
+  {
+    ReadOnly,
+    ReadWrite
+  };
+
+  using Files = std::vector<std::shared_ptr<H5::H5File>>;
+
+  /// Return the pooled file if it serves `mode`, nullptr if the caller must open it
+  ///
+  /// The caller opens the file with OpenFile() and adds it with Add(). A file
+  /// pooled read-only is removed for a read/write request.
+  ///
+  /// @param inMemory set to true if the file is to be opened in memory
+  std::shared_ptr<H5::H5File> Find(const std::string &fileName, Mode mode, bool &inMemory);
+
+  /// Add a file opened after Find(), does nothing if pooling is disabled
+  ///
+  /// @return the pooled file, a file of the same name pooled meanwhile is kept and returned instead
+  std::shared_ptr<H5::H5File> Add(const std::string &fileName, Mode mode, bool inMemory,
+                                  std::shared_ptr<H5::H5File> file);
+
+  /// Open a file, see Find()
+  static std::shared_ptr<H5::H5File> OpenFile(const std::string &fileName, Mode mode, bool inMemory);
+
+  /// Remove the file from the pool, does nothing if the file is not pooled
+  void Close(const std::string &fileName);
+
+  /// Remove all files from the pool
+  void CloseAll();
+
+  /// Return and forget the files removed from the pool, to be closed with CloseFiles()
+  Files TakeClosedFiles();
+
+  /// Flush and close the files, a file still referenced elsewhere is closed when the last reference is dropped
+  static void CloseFiles(Files files);
+
+  /// Return the pooled file if it is open for read/write, nullptr otherwise
+  std::shared_ptr<H5::H5File> GetWritable(const std::string &fileName) const;
+
+  /// Return the canonical paths of all pooled files
+  std::vector<std::string> GetFileNames() const;
+
+  /// Remove all files which were not used for longer than the idle timeout
+  void CloseIdle();
+
+  /// Return the total size of the file images held in memory
+  hsize_t GetMemoryUsage() const;
+
+  void SetCapacity(std::size_t capacity);
+  void SetIdleTimeout(std::chrono::milliseconds timeout);
+
+  /// Enable or disable memory mode, disabling it removes all files held in memory
+  void SetInMemory(bool inMemory);
+
+  /// Set the maximum total size of the file images held in memory
+  void SetMemoryLimit(hsize_t limit);
+
+  std::size_t GetCapacity() const;
+  std::chrono::milliseconds GetIdleTimeout() const;
+  bool GetInMemory() const;
+  hsize_t GetMemoryLimit() const;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Entry
+  {
+    std::shared_ptr<H5::H5File> file;
+    Mode mode;
+    Clock::time_point lastUsed;
+    bool inMemory;
+  };
+
+  bool FitsInMemory(const std::string &fileName) const;
+  void CloseEntry(std::map<std::string, Entry>::iterator it);
+  void EvictExcess();
+  void EvictExcessMemory();
+
+  std::map<std::string, Entry> m_files;
+  Files m_closedFiles; ///< removed from the pool but not yet closed
+  std::size_t m_capacity                  = 0;
+  std::chrono::milliseconds m_idleTimeout = std::chrono::seconds(60);
+  bool m_inMemory                         = false;
+  hsize_t m_memoryLimit                   = 1024 * 1024 * 1024;
+};
@@ -0,0 +1,76 @@
+#include "FileUtils.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <algorithm>
+#include <cctype>
+#include <vector>
+#else
+#include <climits>
+#include <cstdlib>
+#include <sys/stat.h>
+#endif
+
+bool GetFileStamp(const std::string &fileName, FileStamp &stamp)
+{
+#ifdef _WIN32
+  WIN32_FILE_ATTRIBUTE_DATA data;
+  if(!GetFileAttributesExA(fileName.c_str(), GetFileExInfoStandard, &data))
+  {
+    return false;
+  }
+
+  // 100ns intervals since 1601
+  stamp.modificationTime = (static_cast<int64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) |
+                           static_cast<int64_t>(data.ftLastWriteTime.dwLowDateTime);
+  stamp.size = (static_cast<int64_t>(data.nFileSizeHigh) << 32) | static_cast<int64_t>(data.nFileSizeLow);
+#else
+  struct stat buf;
+  if(stat(fileName.c_str(), &buf) != 0)
+  {
+    return false;
+  }
+
+  // ns since the epoch
+#ifdef __APPLE__
+  const auto &mtime = buf.st_mtimespec;
+#else
+  const auto &mtime = buf.st_mtim;
+#endif
+  stamp.modificationTime = static_cast<int64_t>(mtime.tv_sec) * 1000000000 + static_cast<int64_t>(mtime.tv_nsec);
+  stamp.size             = static_cast<int64_t>(buf.st_size);
+#endif
+
+  return true;
+}
+
+std::string GetCanonicalPath(const std::string &fileName)
+{
+#ifdef _WIN32
+  DWORD length = GetFullPathNameA(fileName.c_str(), 0, nullptr, nullptr);
+  if(length == 0)
+  {
+    return fileName;
+  }
+
+  std::vector<char> buf(length);
+  length = GetFullPathNameA(fileName.c_str(), static_cast<DWORD>(buf.size()), buf.data(), nullptr);
+  if(length == 0 || length >= buf.size())
+  {
+    return fileName;
+  }
+
+  std::string path(buf.data(), length);
+  std::transform(path.begin(), path.end(), path.begin(),
+                 [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+  return path;
+#else
+  char buf[PATH_MAX];
+  if(realpath(fileName.c_str(), buf) == nullptr)
+  {
+    return fileName;
+  }
+
+  return std::string(buf);
+#endif
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+/// @brief Modification time and size of a file on disk
+struct FileStamp
+{
+  int64_t modificationTime = 0; ///< platform dependent units, only meaningful for comparison
+  int64_t size             = 0;
+
+  bool operator==(const FileStamp &other) const
+  {
+    return modificationTime == other.modificationTime && size == other.size;
+  }
+
+  bool operator!=(const FileStamp &other) const
+  {
+    return !(*this == other);
+  }
+};
+
+/// @brief Query the modification time and size of a file
+///
+/// @param fileName path to the file
+/// @param stamp    filled with the current stamp of the file
+/// @return false if the file could not be queried
+bool GetFileStamp(const std::string &fileName, FileStamp &stamp);
+
+/// @brief Return the absolute, normalized path of a file suitable as a key for caches
+///
+/// The path is lowercased on Windows. Returns fileName unchanged if it can not be resolved.
+std::string GetCanonicalPath(const std::string &fileName);
@@ -439,6 +439,47 @@ void StringVectorToTextWave(const std::vector<std::string> &stringVector, waveHn
   WMDisposeHandle(textHandle);
 }
 
+TextWaveView::TextWaveView(waveHndl w)
+{
+  if(!w)
+  {
+    throw IgorException(USING_NULL_REFVAR);
+  }
+
+  if(WaveType(w) != TEXT_WAVE_TYPE)
+  {
+    throw IgorException(ERR_INVALID_TYPE, "Wave is not a text wave.");
+  }
+
+  m_numElements = To<size_t>(WavePoints(w));
+
+  // mode = 2, see StringVectorToTextWave for the layout
+  if(int err = GetTextWaveData(w, 2, &m_textHandle))
+  {
+    throw IgorException(err, "Error reading text wave contents.");
+  }
+}
+
+TextWaveView::~TextWaveView()
+{
+  if(m_textHandle != nullptr)
+  {
+    WMDisposeHandle(m_textHandle);
+  }
+}
+
+std::size_t TextWaveView::size() const
+{
+  return m_numElements;
+}
+
+std::string_view TextWaveView::operator[](std::size_t index) const
+{
+  const auto *offsets = reinterpret_cast<const size_t *>(*m_textHandle); // NOLINT
+
+  return std::string_view(*m_textHandle + offsets[index], offsets[index + 1] - offsets[index]); // NOLINT
+}
+
 // @brief Clears a text wave, sets all elements to zero sized strings. Works for
 // 32 and 64 bit
 void ClearTextWave(waveHndl w)
@@ -10,6 +10,7 @@
 #include <limits>
 #include <map>
 #include <string>
+#include <string_view>
 #include <type_traits>
 #include <vector>
 
@@ -182,6 +183,32 @@ void SetDimensionLabels(waveHndl h, int Dimension, const std::vector<std::string
 /// fast
 void StringVectorToTextWave(const std::vector<std::string> &stringVector, waveHndl waveHandle);
 
+/// @brief Read-only access to all elements of a text wave
+///
+/// The wave contents are fetched once with GetTextWaveData using mode 2, the
+/// same offset/data layout StringVectorToTextWave writes. The elements are
+/// returned as string_views into that copy and are only valid as long as the
+/// TextWaveView object lives.
+class TextWaveView
+{
+public:
+  explicit TextWaveView(waveHndl w);
+  ~TextWaveView();
+
+  TextWaveView(const TextWaveView &) = delete;
+  TextWaveView &operator=(const TextWaveView &) = delete;
+
+  /// Return the number of elements
+  std::size_t size() const;
+
+  /// Return the element at index, index is not range checked
+  std::string_view operator[](std::size_t index) const;
+
+private:
+  Handle m_textHandle       = nullptr;
+  std::size_t m_numElements = 0;
+};
+
 /// Throws an IgorException if condition is not met with msg
 void ASSERT(bool cond, const std::string &errorMsg);
 
@@ -367,6 +394,10 @@ bool ReadQFlagImpl(T *params, std::true_type /*unused*/)
   {                                                                                                                    \
     err = HandleException(e, QFlag);                                                                                   \
   }                                                                                                                    \
+  catch(const CompoundEngine::CompoundError &e)                                                                        \
+  {                                                                                                                    \
+    err = HandleException(e, QFlag);                                                                                   \
+  }                                                                                                                    \
   catch(const std::exception &e)                                                                                       \
   {                                                                                                                    \
     err = HandleException(e);                                                                                          \
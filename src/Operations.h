@@ -3,7 +3,8 @@
 #include <XOPStandardHeaders.h> // Include ANSI headers, Mac headers, IgorXOP.h, XOP.h and XOPSupport.h
 
 // Operation template: IPNWB_WriteCompound /Z[=number:ZIn] /Q[=number:QIn] /S=wave:offsetWave /C=wave:sizeWave
-// /REF=wave:tsRefWave /LOC=string:compPath string:fullFileName
+// /REF=wave:tsRefWave /LOC=string:compPath /CHUNK=number:chunkSize /NOCACHE /BUFFER /COMP=number:compLevel /SHUF
+// /ASYNC /WIDE /LATEST=number:latestFormat /GROW string:fullFileName
 
 // Runtime param structure for IPNWB_WriteCompound operation.
 #pragma pack(2) // All structures passed to Igor are two-byte aligned.
@@ -41,6 +42,45 @@ struct IPNWB_WriteCompoundRuntimeParams
   Handle compPath;
   int LOCFlagParamsSet[1];
 
+  // Parameters for /CHUNK flag group.
+  int CHUNKFlagEncountered;
+  double chunkSize;
+  int CHUNKFlagParamsSet[1];
+
+  // Parameters for /NOCACHE flag group.
+  int NOCACHEFlagEncountered;
+  // There are no fields for this group because it has no parameters.
+
+  // Parameters for /BUFFER flag group.
+  int BUFFERFlagEncountered;
+  // There are no fields for this group because it has no parameters.
+
+  // Parameters for /COMP flag group.
+  int COMPFlagEncountered;
+  double compLevel;
+  int COMPFlagParamsSet[1];
+
+  // Parameters for /SHUF flag group.
+  int SHUFFlagEncountered;
+  // There are no fields for this group because it has no parameters.
+
+  // Parameters for /ASYNC flag group.
+  int ASYNCFlagEncountered;
+  // There are no fields for this group because it has no parameters.
+
+  // Parameters for /WIDE flag group.
+  int WIDEFlagEncountered;
+  // There are no fields for this group because it has no parameters.
+
+  // Parameters for /LATEST flag group.
+  int LATESTFlagEncountered;
+  double latestFormat;
+  int LATESTFlagParamsSet[1];
+
+  // Parameters for /GROW flag group.
+  int GROWFlagEncountered;
+  // There are no fields for this group because it has no parameters.
+
   // Main parameters.
 
   // Parameters for simple main group #0.
@@ -58,8 +98,9 @@ typedef struct IPNWB_WriteCompoundRuntimeParams *IPNWB_WriteCompoundRuntimeParam
 #pragma pack() // Reset structure alignment to default.
 
 // Operation template: IPNWB_ReadCompound /Z[=number:ZIn] /Q[=number:QIn] /FREE /S=DataFolderAndName:{offsetWave, real}
-// /C=DataFolderAndName:{sizeWave, real} /REF=DataFolderAndName:{tsRefWave, text} /LOC=string:compPath
-// string:fullFileName
+// /C=DataFolderAndName:{sizeWave, real} /REF=DataFolderAndName:{tsRefWave, text} /LOC=string:compPath /CACHE
+// /RANGE={number:rangeStart, number:rangeCount} /REFI=DataFolderAndName:{refIndexWave, real} /IMG=wave:imageWave
+// [string:fullFileName]
 
 // Runtime param structure for IPNWB_ReadCompound operation.
 #pragma pack(2) // All structures passed to Igor are two-byte aligned.
@@ -101,11 +142,31 @@ struct IPNWB_ReadCompoundRuntimeParams
   Handle compPath;
   int LOCFlagParamsSet[1];
 
+  // Parameters for /CACHE flag group.
+  int CACHEFlagEncountered;
+  // There are no fields for this group because it has no parameters.
+
+  // Parameters for /RANGE flag group.
+  int RANGEFlagEncountered;
+  double rangeStart;
+  double rangeCount;
+  int RANGEFlagParamsSet[2];
+
+  // Parameters for /REFI flag group.
+  int REFIFlagEncountered;
+  DataFolderAndName refIndexWave;
+  int REFIFlagParamsSet[1];
+
+  // Parameters for /IMG flag group.
+  int IMGFlagEncountered;
+  waveHndl imageWave;
+  int IMGFlagParamsSet[1];
+
   // Main parameters.
 
   // Parameters for simple main group #0.
   int fullFileNameEncountered;
-  Handle fullFileName;
+  Handle fullFileName; // Optional parameter.
   int fullFileNameParamsSet[1];
 
   // These are postamble fields that Igor sets.
@@ -116,3 +177,432 @@ struct IPNWB_ReadCompoundRuntimeParams
 typedef struct IPNWB_ReadCompoundRuntimeParams IPNWB_ReadCompoundRuntimeParams;
 typedef struct IPNWB_ReadCompoundRuntimeParams *IPNWB_ReadCompoundRuntimeParamsPtr;
 #pragma pack() // Reset structure alignment to default.
+
+// Operation template: IPNWB_CompoundInfo /Z[=number:ZIn] /Q[=number:QIn] /FREE /LOC=string:compPath
+// /MEM=DataFolderAndName:{memberWave, text} string:fullFileName
+
+// Runtime param structure for IPNWB_CompoundInfo operation.
+#pragma pack(2) // All structures passed to Igor are two-byte aligned.
+struct IPNWB_CompoundInfoRuntimeParams
+{
+  // Flag parameters.
+
+  // Parameters for /Z flag group.
+  int ZFlagEncountered;
+  double ZIn; // Optional parameter.
+  int ZFlagParamsSet[1];
+
+  // Parameters for /Q flag group.
+  int QFlagEncountered;
+  double QIn; // Optional parameter.
+  int QFlagParamsSet[1];
+
+  // Parameters for /FREE flag group.
+  int FREEFlagEncountered;
+  // There are no fields for this group because it has no parameters.
+
+  // Parameters for /LOC flag group.
+  int LOCFlagEncountered;
+  Handle compPath;
+  int LOCFlagParamsSet[1];
+
+  // Parameters for /MEM flag group.
+  int MEMFlagEncountered;
+  DataFolderAndName memberWave;
+  int MEMFlagParamsSet[1];
+
+  // Main parameters.
+
+  // Parameters for simple main group #0.
+  int fullFileNameEncountered;
+  Handle fullFileName;
+  int fullFileNameParamsSet[1];
+
+  // These are postamble fields that Igor sets.
+  int calledFromFunction;       // 1 if called from a user function, 0 otherwise.
+  int calledFromMacro;          // 1 if called from a macro, 0 otherwise.
+  UserFunctionThreadInfoPtr tp; // If not null, we are running from a ThreadSafe function.
+};
+typedef struct IPNWB_CompoundInfoRuntimeParams IPNWB_CompoundInfoRuntimeParams;
+typedef struct IPNWB_CompoundInfoRuntimeParams *IPNWB_CompoundInfoRuntimeParamsPtr;
+#pragma pack() // Reset structure alignment to default.
+
+// Operation template: IPNWB_CloseFile /Z[=number:ZIn] /Q[=number:QIn] /A [string:fullFileName]
+
+// Runtime param structure for IPNWB_CloseFile operation.
+#pragma pack(2) // All structures passed to Igor are two-byte aligned.
+struct IPNWB_CloseFileRuntimeParams
+{
+  // Flag parameters.
+
+  // Parameters for /Z flag group.
+  int ZFlagEncountered;
+  double ZIn; // Optional parameter.
+  int ZFlagParamsSet[1];
+
+  // Parameters for /Q flag group.
+  int QFlagEncountered;
+  double QIn; // Optional parameter.
+  int QFlagParamsSet[1];
+
+  // Parameters for /A flag group.
+  int AFlagEncountered;
+  // There are no fields for this group because it has no parameters.
+
+  // Main parameters.
+
+  // Parameters for simple main group #0.
+  int fullFileNameEncountered;
+  Handle fullFileName; // Optional parameter.
+  int fullFileNameParamsSet[1];
+
+  // These are postamble fields that Igor sets.
+  int calledFromFunction;       // 1 if called from a user function, 0 otherwise.
+  int calledFromMacro;          // 1 if called from a macro, 0 otherwise.
+  UserFunctionThreadInfoPtr tp; // If not null, we are running from a ThreadSafe function.
+};
+typedef struct IPNWB_CloseFileRuntimeParams IPNWB_CloseFileRuntimeParams;
+typedef struct IPNWB_CloseFileRuntimeParams *IPNWB_CloseFileRuntimeParamsPtr;
+#pragma pack() // Reset structure alignment to default.
+
+// Operation template: IPNWB_FlushAll /Z[=number:ZIn] /Q[=number:QIn]
+
+// Runtime param structure for IPNWB_FlushAll operation.
+#pragma pack(2) // All structures passed to Igor are two-byte aligned.
+struct IPNWB_FlushAllRuntimeParams
+{
+  // Flag parameters.
+
+  // Parameters for /Z flag group.
+  int ZFlagEncountered;
+  double ZIn; // Optional parameter.
+  int ZFlagParamsSet[1];
+
+  // Parameters for /Q flag group.
+  int QFlagEncountered;
+  double QIn; // Optional parameter.
+  int QFlagParamsSet[1];
+
+  // These are postamble fields that Igor sets.
+  int calledFromFunction;       // 1 if called from a user function, 0 otherwise.
+  int calledFromMacro;          // 1 if called from a macro, 0 otherwise.
+  UserFunctionThreadInfoPtr tp; // If not null, we are running from a ThreadSafe function.
+};
+typedef struct IPNWB_FlushAllRuntimeParams IPNWB_FlushAllRuntimeParams;
+typedef struct IPNWB_FlushAllRuntimeParams *IPNWB_FlushAllRuntimeParamsPtr;
+#pragma pack() // Reset structure alignment to default.
+
+// Operation template: IPNWB_Configure /Z[=number:ZIn] /Q[=number:QIn] /POOL=number:poolSize
+// /IDLE=number:idleTimeout /BUFROWS=number:bufferRows /BUFBYTES=number:bufferBytes /LATEST=number:latestFormat
+// /THREADS=number:numThreads /INMEM=number:inMemory /MAXMEM=number:maxMemory /DIRECT=number:directChunks
+
+// Runtime param structure for IPNWB_Configure operation.
+#pragma pack(2) // All structures passed to Igor are two-byte aligned.
+struct IPNWB_ConfigureRuntimeParams
+{
+  // Flag parameters.
+
+  // Parameters for /Z flag group.
+  int ZFlagEncountered;
+  double ZIn; // Optional parameter.
+  int ZFlagParamsSet[1];
+
+  // Parameters for /Q flag group.
+  int QFlagEncountered;
+  double QIn; // Optional parameter.
+  int QFlagParamsSet[1];
+
+  // Parameters for /POOL flag group.
+  int POOLFlagEncountered;
+  double poolSize;
+  int POOLFlagParamsSet[1];
+
+  // Parameters for /IDLE flag group.
+  int IDLEFlagEncountered;
+  double idleTimeout;
+  int IDLEFlagParamsSet[1];
+
+  // Parameters for /BUFROWS flag group.
+  int BUFROWSFlagEncountered;
+  double bufferRows;
+  int BUFROWSFlagParamsSet[1];
+
+  // Parameters for /BUFBYTES flag group.
+  int BUFBYTESFlagEncountered;
+  double bufferBytes;
+  int BUFBYTESFlagParamsSet[1];
+
+  // Parameters for /LATEST flag group.
+  int LATESTFlagEncountered;
+  double latestFormat;
+  int LATESTFlagParamsSet[1];
+
+  // Parameters for /THREADS flag group.
+  int THREADSFlagEncountered;
+  double numThreads;
+  int THREADSFlagParamsSet[1];
+
+  // Parameters for /INMEM flag group.
+  int INMEMFlagEncountered;
+  double inMemory;
+  int INMEMFlagParamsSet[1];
+
+  // Parameters for /MAXMEM flag group.
+  int MAXMEMFlagEncountered;
+  double maxMemory;
+  int MAXMEMFlagParamsSet[1];
+
+  // Parameters for /DIRECT flag group.
+  int DIRECTFlagEncountered;
+  double directChunks;
+  int DIRECTFlagParamsSet[1];
+
+  // These are postamble fields that Igor sets.
+  int calledFromFunction;       // 1 if called from a user function, 0 otherwise.
+  int calledFromMacro;          // 1 if called from a macro, 0 otherwise.
+  UserFunctionThreadInfoPtr tp; // If not null, we are running from a ThreadSafe function.
+};
+typedef struct IPNWB_ConfigureRuntimeParams IPNWB_ConfigureRuntimeParams;
+typedef struct IPNWB_ConfigureRuntimeParams *IPNWB_ConfigureRuntimeParamsPtr;
+#pragma pack() // Reset structure alignment to default.
+
+// Operation template: IPNWB_WriteEpochs /Z[=number:ZIn] /Q[=number:QIn] /START=wave:startWave /STOP=wave:stopWave
+// /TAGS=wave:tagsWave /TAGC=wave:tagCountWave /S=wave:offsetWave /C=wave:sizeWave /REF=wave:tsRefWave
+// /TSC=wave:tsCountWave /ID=wave:idWave /TREE=wave:treeLevelWave /LOC=string:tablePath /COMP=number:compLevel /SHUF
+// /WIDE /LATEST=number:latestFormat string:fullFileName
+
+// Runtime param structure for IPNWB_WriteEpochs operation.
+#pragma pack(2) // All structures passed to Igor are two-byte aligned.
+struct IPNWB_WriteEpochsRuntimeParams
+{
+  // Flag parameters.
+
+  // Parameters for /Z flag group.
+  int ZFlagEncountered;
+  double ZIn; // Optional parameter.
+  int ZFlagParamsSet[1];
+
+  // Parameters for /Q flag group.
+  int QFlagEncountered;
+  double QIn; // Optional parameter.
+  int QFlagParamsSet[1];
+
+  // Parameters for /START flag group.
+  int STARTFlagEncountered;
+  waveHndl startWave;
+  int STARTFlagParamsSet[1];
+
+  // Parameters for /STOP flag group.
+  int STOPFlagEncountered;
+  waveHndl stopWave;
+  int STOPFlagParamsSet[1];
+
+  // Parameters for /TAGS flag group.
+  int TAGSFlagEncountered;
+  waveHndl tagsWave;
+  int TAGSFlagParamsSet[1];
+
+  // Parameters for /TAGC flag group.
+  int TAGCFlagEncountered;
+  waveHndl tagCountWave;
+  int TAGCFlagParamsSet[1];
+
+  // Parameters for /S flag group.
+  int SFlagEncountered;
+  waveHndl offsetWave;
+  int SFlagParamsSet[1];
+
+  // Parameters for /C flag group.
+  int CFlagEncountered;
+  waveHndl sizeWave;
+  int CFlagParamsSet[1];
+
+  // Parameters for /REF flag group.
+  int REFFlagEncountered;
+  waveHndl tsRefWave;
+  int REFFlagParamsSet[1];
+
+  // Parameters for /TSC flag group.
+  int TSCFlagEncountered;
+  waveHndl tsCountWave;
+  int TSCFlagParamsSet[1];
+
+  // Parameters for /ID flag group.
+  int IDFlagEncountered;
+  waveHndl idWave;
+  int IDFlagParamsSet[1];
+
+  // Parameters for /TREE flag group.
+  int TREEFlagEncountered;
+  waveHndl treeLevelWave;
+  int TREEFlagParamsSet[1];
+
+  // Parameters for /LOC flag group.
+  int LOCFlagEncountered;
+  Handle tablePath;
+  int LOCFlagParamsSet[1];
+
+  // Parameters for /COMP flag group.
+  int COMPFlagEncountered;
+  double compLevel;
+  int COMPFlagParamsSet[1];
+
+  // Parameters for /SHUF flag group.
+  int SHUFFlagEncountered;
+  // There are no fields for this group because it has no parameters.
+
+  // Parameters for /WIDE flag group.
+  int WIDEFlagEncountered;
+  // There are no fields for this group because it has no parameters.
+
+  // Parameters for /LATEST flag group.
+  int LATESTFlagEncountered;
+  double latestFormat;
+  int LATESTFlagParamsSet[1];
+
+  // Main parameters.
+
+  // Parameters for simple main group #0.
+  int fullFileNameEncountered;
+  Handle fullFileName;
+  int fullFileNameParamsSet[1];
+
+  // These are postamble fields that Igor sets.
+  int calledFromFunction;       // 1 if called from a user function, 0 otherwise.
+  int calledFromMacro;          // 1 if called from a macro, 0 otherwise.
+  UserFunctionThreadInfoPtr tp; // If not null, we are running from a ThreadSafe function.
+};
+typedef struct IPNWB_WriteEpochsRuntimeParams IPNWB_WriteEpochsRuntimeParams;
+typedef struct IPNWB_WriteEpochsRuntimeParams *IPNWB_WriteEpochsRuntimeParamsPtr;
+#pragma pack() // Reset structure alignment to default.
+
+// Operation template: IPNWB_WaitWrites /Z[=number:ZIn] /Q[=number:QIn]
+
+// Runtime param structure for IPNWB_WaitWrites operation.
+#pragma pack(2) // All structures passed to Igor are two-byte aligned.
+struct IPNWB_WaitWritesRuntimeParams
+{
+  // Flag parameters.
+
+  // Parameters for /Z flag group.
+  int ZFlagEncountered;
+  double ZIn; // Optional parameter.
+  int ZFlagParamsSet[1];
+
+  // Parameters for /Q flag group.
+  int QFlagEncountered;
+  double QIn; // Optional parameter.
+  int QFlagParamsSet[1];
+
+  // These are postamble fields that Igor sets.
+  int calledFromFunction;       // 1 if called from a user function, 0 otherwise.
+  int calledFromMacro;          // 1 if called from a macro, 0 otherwise.
+  UserFunctionThreadInfoPtr tp; // If not null, we are running from a ThreadSafe function.
+};
+typedef struct IPNWB_WaitWritesRuntimeParams IPNWB_WaitWritesRuntimeParams;
+typedef struct IPNWB_WaitWritesRuntimeParams *IPNWB_WaitWritesRuntimeParamsPtr;
+#pragma pack() // Reset structure alignment to default.
+
+// Operation template: IPNWB_GetWriteErrors /Z[=number:ZIn] /Q[=number:QIn] /FREE DataFolderAndName:{errorWave, text}
+
+// Runtime param structure for IPNWB_GetWriteErrors operation.
+#pragma pack(2) // All structures passed to Igor are two-byte aligned.
+struct IPNWB_GetWriteErrorsRuntimeParams
+{
+  // Flag parameters.
+
+  // Parameters for /Z flag group.
+  int ZFlagEncountered;
+  double ZIn; // Optional parameter.
+  int ZFlagParamsSet[1];
+
+  // Parameters for /Q flag group.
+  int QFlagEncountered;
+  double QIn; // Optional parameter.
+  int QFlagParamsSet[1];
+
+  // Parameters for /FREE flag group.
+  int FREEFlagEncountered;
+  // There are no fields for this group because it has no parameters.
+
+  // Main parameters.
+
+  // Parameters for simple main group #0.
+  int errorWaveEncountered;
+  DataFolderAndName errorWave;
+  int errorWaveParamsSet[1];
+
+  // These are postamble fields that Igor sets.
+  int calledFromFunction;       // 1 if called from a user function, 0 otherwise.
+  int calledFromMacro;          // 1 if called from a macro, 0 otherwise.
+  UserFunctionThreadInfoPtr tp; // If not null, we are running from a ThreadSafe function.
+};
+typedef struct IPNWB_GetWriteErrorsRuntimeParams IPNWB_GetWriteErrorsRuntimeParams;
+typedef struct IPNWB_GetWriteErrorsRuntimeParams *IPNWB_GetWriteErrorsRuntimeParamsPtr;
+#pragma pack() // Reset structure alignment to default.
+
+// Operation template: IPNWB_ResetStats /Z[=number:ZIn] /Q[=number:QIn]
+
+// Runtime param structure for IPNWB_ResetStats operation.
+#pragma pack(2) // All structures passed to Igor are two-byte aligned.
+struct IPNWB_ResetStatsRuntimeParams
+{
+  // Flag parameters.
+
+  // Parameters for /Z flag group.
+  int ZFlagEncountered;
+  double ZIn; // Optional parameter.
+  int ZFlagParamsSet[1];
+
+  // Parameters for /Q flag group.
+  int QFlagEncountered;
+  double QIn; // Optional parameter.
+  int QFlagParamsSet[1];
+
+  // These are postamble fields that Igor sets.
+  int calledFromFunction;       // 1 if called from a user function, 0 otherwise.
+  int calledFromMacro;          // 1 if called from a macro, 0 otherwise.
+  UserFunctionThreadInfoPtr tp; // If not null, we are running from a ThreadSafe function.
+};
+typedef struct IPNWB_ResetStatsRuntimeParams IPNWB_ResetStatsRuntimeParams;
+typedef struct IPNWB_ResetStatsRuntimeParams *IPNWB_ResetStatsRuntimeParamsPtr;
+#pragma pack() // Reset structure alignment to default.
+
+// Operation template: IPNWB_Finalize /Z[=number:ZIn] /Q[=number:QIn] /LOC=string:compPath string:fullFileName
+
+// Runtime param structure for IPNWB_Finalize operation.
+#pragma pack(2) // All structures passed to Igor are two-byte aligned.
+struct IPNWB_FinalizeRuntimeParams
+{
+  // Flag parameters.
+
+  // Parameters for /Z flag group.
+  int ZFlagEncountered;
+  double ZIn; // Optional parameter.
+  int ZFlagParamsSet[1];
+
+  // Parameters for /Q flag group.
+  int QFlagEncountered;
+  double QIn; // Optional parameter.
+  int QFlagParamsSet[1];
+
+  // Parameters for /LOC flag group.
+  int LOCFlagEncountered;
+  Handle compPath;
+  int LOCFlagParamsSet[1];
+
+  // Main parameters.
+
+  // Parameters for simple main group #0.
+  int fullFileNameEncountered;
+  Handle fullFileName;
+  int fullFileNameParamsSet[1];
+
+  // These are postamble fields that Igor sets.
+  int calledFromFunction;       // 1 if called from a user function, 0 otherwise.
+  int calledFromMacro;          // 1 if called from a macro, 0 otherwise.
+  UserFunctionThreadInfoPtr tp; // If not null, we are running from a ThreadSafe function.
+};
+typedef struct IPNWB_FinalizeRuntimeParams IPNWB_FinalizeRuntimeParams;
+typedef struct IPNWB_FinalizeRuntimeParams *IPNWB_FinalizeRuntimeParamsPtr;
+#pragma pack() // Reset structure alignment to default.
@@ -0,0 +1,564 @@
+/// @file
+/// @brief Native benchmark of appending to and reading from the compound dataset
+///
+/// Generates synthetic NWB files with epochs tables of the requested sizes
+/// and runs each scenario on them:
+///
+/// - create:           new file, all rows written with a single append
+/// - small_appends:    rows appended a few at a time, as during acquisition
+/// - bulk_appends:     rows appended in large batches, as for backfills
+/// - full_read:        all rows read and their references resolved with one cache
+/// - dereference_read: rows read in windows, each with a fresh dereference cache
+///
+/// With --in-memory the appends go to a file opened with the HDF5 core driver,
+/// like IPNWB_Configure /INMEM, and the flush writing it to disk is timed separately.
+///
+/// The results are written as JSON. Peak RSS is the peak of the process so
+/// far, run a single scenario and size per process for exact numbers.
+///
+/// Usage: bench_compound [--rows 1000,100000] [--scenarios create,full_read] [--output results.json]
+///                       [--dir tmpdir] [--timeseries 64] [--append-rows 16] [--max-appends 20000]
+///                       [--bulk-rows 65536] [--window 1024] [--repeat 3] [--format earliest|latest]
+///                       [--grow] [--deflate -1] [--shuffle] [--threads 0] [--no-direct] [--in-memory]
+
+#include "CompoundEngine.h"
+
+#include <fmt/format.h>
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+using namespace fmt::literals;
+using namespace CompoundEngine;
+
+using Clock = std::chrono::steady_clock;
+
+static const std::string COMP_PATH = "/intervals/epochs/timeseries";
+
+struct Options
+{
+  std::vector<std::size_t> rows = {1000, 10000, 100000, 1000000};
+  std::vector<std::string> scenarios;
+  std::string output;
+  std::string dir           = ".";
+  std::size_t numTimeSeries = 64;
+  std::size_t appendRows    = 16;
+  std::size_t maxAppends    = 20000;
+  std::size_t bulkRows      = 65536;
+  std::size_t window        = 1024;
+  std::size_t repeat        = 3;
+  CreationOptions creation; ///< layout of the datasets and how they are appended to
+  bool inMemory = false;    ///< append to files held in memory by the core driver
+};
+
+/// Synthetic epochs rows, offsets and sizes of consecutive sweeps into a few timeseries
+struct SyntheticRows
+{
+  std::vector<int64_t> offsets;
+  std::vector<int64_t> sizes;
+  std::vector<std::string> paths;
+  std::vector<std::string_view> refs;
+
+  /// Return rows [first, first + count)
+  CompoundRows Get(std::size_t first, std::size_t count) const
+  {
+    CompoundRows rows;
+    rows.numRows = count;
+    rows.offsets = {offsets.data() + first, true};
+    rows.sizes   = {sizes.data() + first, true};
+    rows.refs.assign(refs.begin() + first, refs.begin() + first + count);
+
+    return rows;
+  }
+};
+
+struct Result
+{
+  std::string scenario;
+  std::size_t rows = 0;
+  std::vector<double> latencies; ///< seconds per call
+  double seconds      = 0;
+  double flushSeconds = 0; ///< flush after the appends
+  long peakRSSKiB     = 0;
+  std::string phases; ///< JSON object of the phase counters
+};
+
+std::vector<std::string> Split(const std::string &str)
+{
+  std::vector<std::string> parts;
+  std::stringstream stream(str);
+  std::string part;
+  while(std::getline(stream, part, ','))
+  {
+    if(!part.empty())
+    {
+      parts.push_back(part);
+    }
+  }
+
+  return parts;
+}
+
+Options ParseOptions(int argc, char **argv)
+{
+  Options options;
+
+  for(int i = 1; i < argc; i++)
+  {
+    const std::string arg = argv[i];
+
+    if(arg == "--grow")
+    {
+      options.creation.growCapacity = true;
+      continue;
+    }
+    if(arg == "--shuffle")
+    {
+      options.creation.shuffle = true;
+      continue;
+    }
+    if(arg == "--no-direct")
+    {
+      options.creation.directChunks = false;
+      continue;
+    }
+    if(arg == "--in-memory")
+    {
+      options.inMemory = true;
+      continue;
+    }
+
+    if(i + 1 >= argc)
+    {
+      throw std::runtime_error("Missing value for {}."_format(arg));
+    }
+    const std::string value = argv[++i];
+
+    if(arg == "--rows")
+    {
+      options.rows.clear();
+      for(const auto &part : Split(value))
+      {
+        options.rows.push_back(std::stoull(part));
+      }
+    }
+    else if(arg == "--scenarios")
+    {
+      options.scenarios = Split(value);
+    }
+    else if(arg == "--output")
+    {
+      options.output = value;
+    }
+    else if(arg == "--dir")
+    {
+      options.dir = value;
+    }
+    else if(arg == "--timeseries")
+    {
+      options.numTimeSeries = std::max<std::size_t>(1, std::stoull(value));
+    }
+    else if(arg == "--append-rows")
+    {
+      options.appendRows = std::max<std::size_t>(1, std::stoull(value));
+    }
+    else if(arg == "--max-appends")
+    {
+      options.maxAppends = std::max<std::size_t>(1, std::stoull(value));
+    }
+    else if(arg == "--bulk-rows")
+    {
+      options.bulkRows = std::max<std::size_t>(1, std::stoull(value));
+    }
+    else if(arg == "--window")
+    {
+      options.window = std::max<std::size_t>(1, std::stoull(value));
+    }
+    else if(arg == "--repeat")
+    {
+      options.repeat = std::max<std::size_t>(1, std::stoull(value));
+    }
+    else if(arg == "--deflate")
+    {
+      options.creation.deflateLevel = std::stoi(value);
+      if(options.creation.deflateLevel < -1 || options.creation.deflateLevel > 9)
+      {
+        throw std::runtime_error("--deflate must be between -1 and 9.");
+      }
+    }
+    else if(arg == "--threads")
+    {
+      options.creation.numThreads = static_cast<unsigned int>(std::stoul(value));
+    }
+    else if(arg == "--format")
+    {
+      if(value != "earliest" && value != "latest")
+      {
+        throw std::runtime_error("Unknown format {}, use earliest or latest."_format(value));
+      }
+      options.creation.latestFormat = value == "latest" ? LatestFormat::Always : LatestFormat::Never;
+    }
+    else
+    {
+      throw std::runtime_error("Unknown option {}."_format(arg));
+    }
+  }
+
+  return options;
+}
+
+std::string GetTimeSeriesPath(std::size_t index)
+{
+  return "/acquisition/timeseries_{}"_format(index);
+}
+
+/// Return `numRows` rows referencing `numTimeSeries` timeseries, the same for every run
+SyntheticRows MakeRows(std::size_t numRows, std::size_t numTimeSeries)
+{
+  SyntheticRows rows;
+  rows.offsets.resize(numRows);
+  rows.sizes.resize(numRows);
+  rows.refs.resize(numRows);
+
+  for(std::size_t i = 0; i < numTimeSeries; i++)
+  {
+    rows.paths.push_back(GetTimeSeriesPath(i));
+  }
+
+  std::mt19937_64 engine(42);
+  std::uniform_int_distribution<int64_t> sizeDist(100, 100000);
+  std::vector<int64_t> ends(numTimeSeries, 0);
+  for(std::size_t i = 0; i < numRows; i++)
+  {
+    // epochs refer to consecutive ranges of the sweeps, a few sweeps in turn
+    const auto index = (i / 8) % numTimeSeries;
+    rows.offsets[i]  = ends[index];
+    rows.sizes[i]    = sizeDist(engine);
+    rows.refs[i]     = rows.paths[index];
+    ends[index] += rows.sizes[i];
+  }
+
+  return rows;
+}
+
+/// Create a new file with the timeseries groups the rows reference
+H5::H5File CreateFile(const std::string &fileName, std::size_t numTimeSeries)
+{
+  H5::H5File file(fileName, H5F_ACC_TRUNC);
+  file.createGroup("/acquisition");
+  file.createGroup("/intervals");
+  file.createGroup("/intervals/epochs");
+  for(std::size_t i = 0; i < numTimeSeries; i++)
+  {
+    file.createGroup(GetTimeSeriesPath(i));
+  }
+
+  return file;
+}
+
+/// Open an existing file for appending, in memory with a backing store if requested
+H5::H5File OpenForAppends(const std::string &fileName, bool inMemory)
+{
+  if(!inMemory)
+  {
+    return H5::H5File(fileName, H5F_ACC_RDWR);
+  }
+
+  // same settings as the file pool of the XOP
+  H5::FileAccPropList fapl;
+  fapl.setCore(4 * 1024 * 1024, true);
+  H5Pset_core_write_tracking(fapl.getId(), true, 64 * 1024);
+
+  return H5::H5File(fileName, H5F_ACC_RDWR, H5::FileCreatPropList::DEFAULT, fapl);
+}
+
+/// Append all rows in batches of `batchRows`, returns the latency of every append
+std::vector<double> AppendInBatches(const H5::H5File &file, const SyntheticRows &rows, std::size_t numRows,
+                                    std::size_t batchRows, const CreationOptions &creation, Stats &stats)
+{
+  std::vector<double> latencies;
+  for(std::size_t first = 0; first < numRows; first += batchRows)
+  {
+    const auto count = std::min(batchRows, numRows - first);
+    const auto start = Clock::now();
+    AppendRows(file, COMP_PATH, creation, rows.Get(first, count), true, stats);
+    latencies.push_back(std::chrono::duration<double>(Clock::now() - start).count());
+  }
+
+  return latencies;
+}
+
+/// Read `count` rows starting at `first` and resolve their references like IPNWB_ReadCompound
+void ReadRows(const H5::H5File &file, DereferenceCache &cache, hsize_t first, hsize_t count, Stats &stats)
+{
+  PhaseTimer timer(stats, Stats::Phase::ReadCompound);
+  timer.Add(count, 0);
+
+  PhaseTimer openTimer(stats, Stats::Phase::ReadCompoundOpen);
+  bool is64Bit        = false;
+  H5::DataSet dataSet = OpenCompound(file, COMP_PATH, is64Bit);
+  openTimer.Stop();
+
+  std::vector<int64_t> offsets(count);
+  std::vector<int64_t> sizes(count);
+  std::vector<hobj_ref_t> refs;
+  {
+    PhaseTimer readTimer(stats, Stats::Phase::ReadCompoundRead);
+    refs = ReadReferences(dataSet, first, count);
+    ReadIntMember(dataSet, {offsets.data(), true}, MEMBERNAME_START, first, count);
+    ReadIntMember(dataSet, {sizes.data(), true}, MEMBERNAME_COUNT, first, count);
+    readTimer.Add(count, count * COMPOUND_MAX_ROW_SIZE);
+  }
+
+  PhaseTimer dereferenceTimer(stats, Stats::Phase::ReadCompoundDereference);
+  const auto resolved = ResolveReferences(file, refs, cache, false);
+  dereferenceTimer.Add(count, 0);
+
+  if(resolved.paths.size() != count)
+  {
+    throw std::runtime_error("Read {} references instead of {}."_format(resolved.paths.size(), count));
+  }
+}
+
+long GetPeakRSSKiB()
+{
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+
+#ifdef __APPLE__
+  return usage.ru_maxrss / 1024;
+#else
+  return usage.ru_maxrss;
+#endif
+}
+
+std::string FormatPhases(const Stats &stats)
+{
+  std::string json = "{";
+  for(std::size_t i = 0; i < Stats::NUM_PHASES; i++)
+  {
+    const auto phase    = static_cast<Stats::Phase>(i);
+    const auto snapshot = stats.Get(phase);
+    if(snapshot.calls == 0)
+    {
+      continue;
+    }
+
+    json += "{}\"{}\": {{\"calls\": {}, \"seconds\": {:.6f}, \"rows\": {}, \"bytes\": {}}}"_format(
+        json.size() > 1 ? ", " : "", Stats::GetPhaseName(phase), snapshot.calls,
+        static_cast<double>(snapshot.nanoseconds) * 1e-9, snapshot.rows, snapshot.bytes);
+  }
+
+  return json + "}";
+}
+
+/// Return the nearest-rank percentile of sorted values
+double GetPercentile(const std::vector<double> &sorted, double percentile)
+{
+  if(sorted.empty())
+  {
+    return 0;
+  }
+
+  const auto rank = static_cast<std::size_t>(percentile / 100.0 * static_cast<double>(sorted.size()) + 0.5);
+
+  return sorted[std::min(sorted.size() - 1, rank == 0 ? 0 : rank - 1)];
+}
+
+std::string FormatResult(const Result &result)
+{
+  auto sorted = result.latencies;
+  std::sort(sorted.begin(), sorted.end());
+
+  const auto toMicroseconds = [](double seconds) { return seconds * 1e6; };
+  const auto rowsPerSecond  = result.seconds > 0 ? static_cast<double>(result.rows) / result.seconds : 0;
+
+  return "    {{\"scenario\": \"{}\", \"rows\": {}, \"calls\": {}, \"seconds\": {:.6f}, \"rows_per_second\": {:.1f}, "
+         "\"latency_us\": {{\"p50\": {:.1f}, \"p90\": {:.1f}, \"p99\": {:.1f}, \"max\": {:.1f}}}, "
+         "\"flush_seconds\": {:.6f}, \"peak_rss_kib\": {}, \"phases\": {}}}"_format(
+             result.scenario, result.rows, sorted.size(), result.seconds, rowsPerSecond,
+             toMicroseconds(GetPercentile(sorted, 50)), toMicroseconds(GetPercentile(sorted, 90)),
+             toMicroseconds(GetPercentile(sorted, 99)), toMicroseconds(sorted.empty() ? 0 : sorted.back()),
+             result.flushSeconds, result.peakRSSKiB, result.phases);
+}
+
+double Sum(const std::vector<double> &values)
+{
+  double sum = 0;
+  for(auto value : values)
+  {
+    sum += value;
+  }
+
+  return sum;
+}
+
+/// Run the scenario `name` with `numRows` rows
+Result RunScenario(const Options &options, const std::string &name, std::size_t numRows)
+{
+  const auto fileName = "{}/bench_compound_{}_{}.h5"_format(options.dir, name, numRows);
+  const auto rows     = MakeRows(numRows, options.numTimeSeries);
+
+  Stats stats;
+  Result result;
+  result.scenario = name;
+  result.rows     = numRows;
+
+  if(name == "create")
+  {
+    for(std::size_t i = 0; i < options.repeat; i++)
+    {
+      const auto start = Clock::now();
+      {
+        auto file = CreateFile(fileName, options.numTimeSeries);
+        AppendRows(file, COMP_PATH, options.creation, rows.Get(0, numRows), true, stats);
+      }
+      result.latencies.push_back(std::chrono::duration<double>(Clock::now() - start).count());
+    }
+    result.seconds = Sum(result.latencies);
+    result.rows    = numRows * options.repeat;
+  }
+  else if(name == "small_appends" || name == "bulk_appends")
+  {
+    const bool small     = name == "small_appends";
+    const auto batchRows = small ? options.appendRows : options.bulkRows;
+    // every small append is a separate call, so their number is limited
+    result.rows = small ? std::min(numRows, options.maxAppends * batchRows) : numRows;
+
+    CreateFile(fileName, options.numTimeSeries).close();
+
+    auto file        = OpenForAppends(fileName, options.inMemory);
+    result.latencies = AppendInBatches(file, rows, result.rows, batchRows, options.creation, stats);
+    result.seconds   = Sum(result.latencies);
+
+    const auto start = Clock::now();
+    file.flush(H5F_SCOPE_GLOBAL);
+    result.flushSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+  }
+  else if(name == "full_read" || name == "dereference_read")
+  {
+    {
+      auto file = CreateFile(fileName, options.numTimeSeries);
+      AppendInBatches(file, rows, numRows, options.bulkRows, options.creation, stats);
+    }
+    stats.Reset();
+
+    H5::H5File file(fileName, H5F_ACC_RDONLY);
+    if(name == "full_read")
+    {
+      for(std::size_t i = 0; i < options.repeat; i++)
+      {
+        DereferenceCache cache;
+        const auto start = Clock::now();
+        ReadRows(file, cache, 0, numRows, stats);
+        result.latencies.push_back(std::chrono::duration<double>(Clock::now() - start).count());
+      }
+      result.rows = numRows * options.repeat;
+    }
+    else
+    {
+      // like IPNWB_ReadCompound /RANGE without /CACHE, every read resolves its references again
+      for(std::size_t first = 0; first < numRows; first += options.window)
+      {
+        DereferenceCache cache;
+        const auto count = std::min(options.window, numRows - first);
+        const auto start = Clock::now();
+        ReadRows(file, cache, first, count, stats);
+        result.latencies.push_back(std::chrono::duration<double>(Clock::now() - start).count());
+      }
+    }
+    result.seconds = Sum(result.latencies);
+  }
+  else
+  {
+    throw std::runtime_error("Unknown scenario {}."_format(name));
+  }
+
+  result.peakRSSKiB = GetPeakRSSKiB();
+  result.phases     = FormatPhases(stats);
+  std::remove(fileName.c_str());
+
+  return result;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  try
+  {
+    auto options = ParseOptions(argc, argv);
+    if(options.scenarios.empty())
+    {
+      options.scenarios = {"create", "small_appends", "bulk_appends", "full_read", "dereference_read"};
+    }
+
+    // errors are reported with exceptions
+    H5::Exception::dontPrint();
+
+    unsigned int major = 0, minor = 0, release = 0;
+    H5get_libversion(&major, &minor, &release);
+
+    std::vector<std::string> results;
+    for(auto numRows : options.rows)
+    {
+      for(const auto &scenario : options.scenarios)
+      {
+        const auto result = RunScenario(options, scenario, numRows);
+        std::fprintf(stderr, "%s %zu rows: %.3f s\n", scenario.c_str(), result.rows, result.seconds);
+        results.push_back(FormatResult(result));
+      }
+    }
+
+    std::string json = "{{\n  \"benchmark\": \"compound\",\n  \"timestamp\": {},\n  \"hdf5\": \"{}.{}.{}\",\n"
+                       "  \"timeseries\": {},\n  \"append_rows\": {},\n  \"bulk_rows\": {},\n  \"window\": {},\n"
+                       "  \"format\": \"{}\",\n  \"grow\": {},\n  \"deflate\": {},\n  \"shuffle\": {},\n"
+                       "  \"direct_chunks\": {},\n  \"threads\": {},\n  \"in_memory\": {},\n  \"results\": [\n"_format(
+                           std::time(nullptr), major, minor, release, options.numTimeSeries, options.appendRows,
+                           options.bulkRows, options.window,
+                           options.creation.latestFormat == LatestFormat::Always ? "latest" : "earliest",
+                           options.creation.growCapacity, options.creation.deflateLevel, options.creation.shuffle,
+                           options.creation.directChunks, options.creation.numThreads, options.inMemory);
+    for(std::size_t i = 0; i < results.size(); i++)
+    {
+      json += results[i] + (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    json += "  ]\n}\n";
+
+    FILE *out = options.output.empty() ? stdout : std::fopen(options.output.c_str(), "w");
+    if(out == nullptr)
+    {
+      throw std::runtime_error("Could not open {}."_format(options.output));
+    }
+    std::fputs(json.c_str(), out);
+    if(out != stdout)
+    {
+      std::fclose(out);
+    }
+  }
+  catch(const H5::Exception &e)
+  {
+    std::fprintf(stderr, "HDF5 error: %s\n", e.getCDetailMsg());
+    return EXIT_FAILURE;
+  }
+  catch(const std::exception &e)
+  {
+    std::fprintf(stderr, "Error: %s\n", e.what());
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
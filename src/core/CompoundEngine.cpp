@@ -0,0 +1,1053 @@
+#include "CompoundEngine.h"
+
+#include <fmt/format.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <future>
+#include <limits>
+#include <unordered_map>
+
+namespace CompoundEngine
+{
+
+using namespace fmt::literals;
+
+const std::string MEMBERNAME_START = "idx_start";
+const std::string MEMBERNAME_COUNT = "count";
+const std::string MEMBERNAME_REF   = "timeseries";
+
+const std::string COLUMN_ID               = "id";
+const std::string COLUMN_START_TIME       = "start_time";
+const std::string COLUMN_STOP_TIME        = "stop_time";
+const std::string COLUMN_TAGS             = "tags";
+const std::string COLUMN_TAGS_INDEX       = "tags_index";
+const std::string COLUMN_TIMESERIES       = "timeseries";
+const std::string COLUMN_TIMESERIES_INDEX = "timeseries_index";
+const std::string COLUMN_TREELEVEL        = "treelevel";
+
+const std::string ATTRIBUTE_NUM_ROWS = "ipnwb_num_rows";
+
+namespace
+{
+const int MEMBERNUMBER         = 3;
+const int MEMBERNAME_START_IDX = 0;
+const int MEMBERNAME_COUNT_IDX = 1;
+const int MEMBERNAME_REF_IDX   = 2;
+
+// chunk size limits in bytes for automatic chunking of new datasets
+const hsize_t CHUNK_MIN_BYTES = 4 * 1024;
+const hsize_t CHUNK_MAX_BYTES = 64 * 1024;
+// number of times the initial rows are expected to be appended again
+const hsize_t CHUNK_EXPECTED_GROWTH = 4;
+// factor by which datasets grown in capacity steps are extended
+const hsize_t CAPACITY_GROWTH = 2;
+// full chunks assembled at once by the direct chunk writes, bounds their memory use
+const hsize_t DIRECT_CHUNKS_PER_BATCH = 64;
+
+/// @brief Return a memory type which selects only the compound member `name`
+H5::CompType GetMemberType(const std::string &name, const H5::PredType &type)
+{
+  H5::CompType compType(type.getSize());
+  compType.insertMember(name, 0, type);
+
+  return compType;
+}
+
+/// @brief Return the memory type of 32bit or 64bit integers
+const H5::PredType &GetMemoryType(bool is64Bit)
+{
+  return is64Bit ? H5::PredType::NATIVE_INT64 : H5::PredType::NATIVE_INT32;
+}
+
+/// @brief Read ATTRIBUTE_NUM_ROWS of the dataset, clamped to its capacity
+///
+/// @return false if the dataset has no such attribute
+bool ReadNumRowsAttribute(const H5::DataSet &dataSet, hsize_t &numRows)
+{
+  if(!dataSet.attrExists(ATTRIBUTE_NUM_ROWS))
+  {
+    return false;
+  }
+
+  uint64_t value = 0;
+  dataSet.openAttribute(ATTRIBUTE_NUM_ROWS).read(H5::PredType::NATIVE_UINT64, &value);
+  numRows = std::min<hsize_t>(value, GetCapacity(dataSet));
+
+  return true;
+}
+
+/// @brief Write ATTRIBUTE_NUM_ROWS of the dataset, creating it if necessary
+void WriteNumRowsAttribute(const H5::DataSet &dataSet, hsize_t numRows)
+{
+  const uint64_t value = numRows;
+
+  if(dataSet.attrExists(ATTRIBUTE_NUM_ROWS))
+  {
+    dataSet.openAttribute(ATTRIBUTE_NUM_ROWS).write(H5::PredType::NATIVE_UINT64, &value);
+    return;
+  }
+
+  dataSet.createAttribute(ATTRIBUTE_NUM_ROWS, H5::PredType::STD_U64LE, H5::DataSpace(H5S_SCALAR))
+      .write(H5::PredType::NATIVE_UINT64, &value);
+}
+
+/// New rows of a 1D dataset, see ExtendDataSet()
+struct AppendedRows
+{
+  H5::DataSet dataSet;
+  H5::DataSpace fileDataSpace; ///< the new rows are selected
+  H5::DataSpace memDataSpace;
+  bool storeNumRows = false; ///< true if the dataset is grown in capacity steps
+  hsize_t numRows   = 0;     ///< rows after the append
+  bool created      = false; ///< true if the dataset did not exist before
+  hsize_t oldExtent = 0;     ///< extent before the append, see RollbackAppend()
+};
+
+/// @brief Record the appended rows once they are written, see ATTRIBUTE_NUM_ROWS
+void FinishAppend(const AppendedRows &rows)
+{
+  if(rows.storeNumRows)
+  {
+    WriteNumRowsAttribute(rows.dataSet, rows.numRows);
+  }
+}
+
+/// Filter of the pipeline of a dataset which is written with direct chunk writes
+struct ChunkFilter
+{
+  H5Z_filter_t id;
+  int deflateLevel;
+};
+
+/// @brief Return the filters of the compound dataset if its chunks can be written directly
+///
+/// @return false if the rows must be written through the HDF5 filter pipeline
+bool GetDirectChunkFilters(const H5::DataSet &dataSet, const H5::CompType &fileType, std::vector<ChunkFilter> &filters)
+{
+  // the file layout of the members is the memory layout of a little-endian host
+  if(!(H5::PredType::NATIVE_INT64 == H5::PredType::STD_I64LE) ||
+     sizeof(hobj_ref_t) != H5::PredType::STD_REF_OBJ.getSize())
+  {
+    return false;
+  }
+
+  if(!(fileType == GetCompoundFileType(fileType.getSize() == COMPOUND_MAX_ROW_SIZE)))
+  {
+    return false;
+  }
+
+  const auto createPropList = dataSet.getCreatePlist();
+  for(int i = 0; i < createPropList.getNfilters(); i++)
+  {
+    unsigned int flags, filterConfig;
+    unsigned int values[8] = {};
+    size_t numValues       = 8;
+    char name[64]          = {};
+    const auto filter      = createPropList.getFilter(i, flags, numValues, values, sizeof(name), name, filterConfig);
+
+    if(filter == H5Z_FILTER_DEFLATE && numValues > 0)
+    {
+      filters.push_back({filter, static_cast<int>(values[0])});
+    }
+    else if(filter == H5Z_FILTER_SHUFFLE)
+    {
+      filters.push_back({filter, 0});
+    }
+    else
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/// @brief Return the chunk of `chunkSize` rows starting at row `first` of the columns, as stored in the file
+///
+/// The rows are assembled in the file layout of the compound and then passed
+/// through `filters` like the HDF5 filter pipeline would do.
+std::vector<unsigned char> AssembleChunk(const IntColumn &offsets, const IntColumn &sizes, const hobj_ref_t *refs,
+                                         std::size_t first, hsize_t chunkSize, std::size_t rowSize,
+                                         const std::vector<ChunkFilter> &filters)
+{
+  const std::size_t intSize = (rowSize - sizeof(hobj_ref_t)) / 2;
+
+  std::vector<unsigned char> chunk(chunkSize * rowSize);
+  for(hsize_t i = 0; i < chunkSize; i++)
+  {
+    unsigned char *row = chunk.data() + i * rowSize;
+    const int64_t offset = offsets[first + i];
+    const int64_t size   = sizes[first + i];
+
+    if(intSize == sizeof(int64_t))
+    {
+      std::memcpy(row, &offset, intSize);
+      std::memcpy(row + intSize, &size, intSize);
+    }
+    else
+    {
+      // Needs64Bit() guarantees that the values fit
+      const auto offset32 = static_cast<int32_t>(offset);
+      const auto size32   = static_cast<int32_t>(size);
+      std::memcpy(row, &offset32, intSize);
+      std::memcpy(row + intSize, &size32, intSize);
+    }
+    std::memcpy(row + 2 * intSize, &refs[first + i], sizeof(hobj_ref_t));
+  }
+
+  std::vector<unsigned char> filtered;
+  for(const auto &filter : filters)
+  {
+    if(filter.id == H5Z_FILTER_SHUFFLE)
+    {
+      // byte j of every row goes to the j-th block, the element size of the filter is the row size
+      filtered.resize(chunk.size());
+      for(std::size_t j = 0; j < rowSize; j++)
+      {
+        unsigned char *block = filtered.data() + j * chunkSize;
+        for(hsize_t i = 0; i < chunkSize; i++)
+        {
+          block[i] = chunk[i * rowSize + j];
+        }
+      }
+    }
+    else
+    {
+      // same as the deflate filter of HDF5
+      auto numBytes = compressBound(static_cast<uLong>(chunk.size()));
+      filtered.resize(numBytes);
+      if(compress2(filtered.data(), &numBytes, chunk.data(), static_cast<uLong>(chunk.size()), filter.deflateLevel) !=
+         Z_OK)
+      {
+        throw CompoundError(CompoundError::Kind::HDF5, "Could not compress a chunk of the compound.");
+      }
+      filtered.resize(numBytes);
+    }
+
+    chunk.swap(filtered);
+  }
+
+  return chunk;
+}
+
+/// @brief Write the full chunks of the rows `[fileFirst, fileFirst + numRows)` directly
+///
+/// Row `fileFirst` of the dataset is row `first` of the columns. Batches of
+/// chunks are assembled on `numThreads` threads, HDF5 is only called from the
+/// calling thread.
+///
+/// @return number of bytes stored
+hsize_t WriteFullChunks(const H5::DataSet &dataSet, const IntColumn &offsets, const IntColumn &sizes,
+                        const hobj_ref_t *refs, std::size_t first, hsize_t fileFirst, hsize_t numRows,
+                        hsize_t chunkSize, std::size_t rowSize, const std::vector<ChunkFilter> &filters,
+                        unsigned int numThreads)
+{
+  const hsize_t numChunks = numRows / chunkSize;
+  hsize_t numBytes        = 0;
+
+  for(hsize_t batchStart = 0; batchStart < numChunks; batchStart += DIRECT_CHUNKS_PER_BATCH)
+  {
+    const auto batchSize = std::min(DIRECT_CHUNKS_PER_BATCH, numChunks - batchStart);
+    std::vector<std::vector<unsigned char>> chunks(batchSize);
+
+    auto assemble = [&](hsize_t begin, hsize_t step) {
+      for(hsize_t i = begin; i < batchSize; i += step)
+      {
+        const auto chunkFirst = first + (batchStart + i) * chunkSize;
+        chunks[i]             = AssembleChunk(offsets, sizes, refs, chunkFirst, chunkSize, rowSize, filters);
+      }
+    };
+
+    const auto numWorkers = std::min<hsize_t>(numThreads, batchSize);
+    if(numWorkers <= 1)
+    {
+      assemble(0, 1);
+    }
+    else
+    {
+      std::vector<std::future<void>> workers;
+      for(hsize_t worker = 0; worker < numWorkers; worker++)
+      {
+        workers.push_back(std::async(std::launch::async, assemble, worker, numWorkers));
+      }
+      // get() rethrows the errors of the workers, but all must be finished before leaving
+      for(auto &worker : workers)
+      {
+        worker.wait();
+      }
+      for(auto &worker : workers)
+      {
+        worker.get();
+      }
+    }
+
+    for(hsize_t i = 0; i < batchSize; i++)
+    {
+      hsize_t offset = fileFirst + (batchStart + i) * chunkSize;
+      if(H5Dwrite_chunk(dataSet.getId(), H5P_DEFAULT, 0, &offset, chunks[i].size(), chunks[i].data()) < 0)
+      {
+        throw CompoundError(CompoundError::Kind::HDF5, "Could not write a chunk of the compound.");
+      }
+      numBytes += chunks[i].size();
+    }
+  }
+
+  return numBytes;
+}
+
+/// @brief Extend the 1D dataset `name` by `numRows` rows, creating it with `fileType` if it does not exist
+AppendedRows ExtendDataSet(const H5::Group &loc, const std::string &name, const H5::DataType &fileType,
+                           hsize_t numRows, const CreationOptions &options)
+{
+  AppendedRows rows;
+  hsize_t oldSize = 0;
+
+  if(loc.exists(name))
+  {
+    rows.dataSet = loc.openDataSet(name);
+    if(rows.dataSet.getCreatePlist().getLayout() != H5D_CHUNKED)
+    {
+      throw CompoundError(CompoundError::Kind::HDF5, "Existing dataset is not "
+                                                     "chunked. Can not append new data.");
+    }
+
+    const hsize_t capacity = GetCapacity(rows.dataSet);
+    const bool hasNumRows  = ReadNumRowsAttribute(rows.dataSet, oldSize);
+    rows.oldExtent         = capacity;
+    if(!hasNumRows)
+    {
+      oldSize = capacity;
+    }
+
+    rows.storeNumRows = hasNumRows || options.growCapacity;
+    rows.numRows      = oldSize + numRows;
+    if(rows.numRows > capacity)
+    {
+      // most appends to a dataset grown in capacity steps fit into the unused rows
+      hsize_t newSize = rows.storeNumRows ? std::max(rows.numRows, capacity * CAPACITY_GROWTH) : rows.numRows;
+      rows.dataSet.extend(&newSize);
+    }
+  }
+  else
+  {
+    auto dsetPropList = GetCreatePropList(options, numRows, fileType.getSize());
+
+    hsize_t capacity = numRows;
+    if(options.growCapacity)
+    {
+      hsize_t chunkSize = 0;
+      dsetPropList.getChunk(1, &chunkSize);
+      capacity = std::max(numRows, chunkSize);
+    }
+
+    hsize_t maxDims = H5S_UNLIMITED;
+    H5::DataSpace dataSpace(1, &capacity, &maxDims);
+
+    ApplyFileFormat(loc, options.latestFormat);
+
+    rows.dataSet      = loc.createDataSet(name, fileType, dataSpace, dsetPropList);
+    rows.storeNumRows = options.growCapacity;
+    rows.numRows      = numRows;
+    rows.created      = true;
+  }
+
+  rows.fileDataSpace = rows.dataSet.getSpace();
+  if(numRows > 0)
+  {
+    rows.fileDataSpace.selectHyperslab(H5S_SELECT_SET, &numRows, &oldSize);
+  }
+  rows.memDataSpace = H5::DataSpace(1, &numRows, nullptr);
+
+  return rows;
+}
+
+/// @brief Undo ExtendDataSet() after the new rows could not be written
+///
+/// New datasets are removed, existing ones are shrunk to their old extent,
+/// which discards rows already written. ATTRIBUTE_NUM_ROWS is only written by
+/// FinishAppend() and still holds the old rows. Errors are ignored as the
+/// caller rethrows the original one.
+void RollbackAppend(const H5::Group &loc, const std::string &name, const AppendedRows &rows) noexcept
+{
+  try
+  {
+    if(rows.created)
+    {
+      loc.unlink(name);
+    }
+    else if(GetCapacity(rows.dataSet) != rows.oldExtent)
+    {
+      hsize_t oldExtent = rows.oldExtent;
+      H5Dset_extent(rows.dataSet.getId(), &oldExtent);
+    }
+  }
+  catch(...)
+  {
+  }
+}
+
+/// Caller's buffer of a file image, see OpenFileImage()
+struct FileImage
+{
+  const void *data;
+  std::size_t size;
+};
+
+// The core driver allocates and copies the image when it is set in the
+// property list, when the list is copied and when the file is opened. The
+// callbacks hand out the caller's buffer for all of these, so the image is
+// never copied. A read-only file never resizes or writes its image.
+
+void *AllocateFileImage(size_t size, H5FD_file_image_op_t /*op*/, void *udata)
+{
+  auto image = static_cast<FileImage *>(udata);
+
+  return size == image->size ? const_cast<void *>(image->data) : nullptr;
+}
+
+void *CopyFileImage(void *dest, const void *src, size_t /*size*/, H5FD_file_image_op_t /*op*/, void * /*udata*/)
+{
+  return dest == src ? dest : nullptr;
+}
+
+void *ResizeFileImage(void * /*ptr*/, size_t /*size*/, H5FD_file_image_op_t /*op*/, void * /*udata*/)
+{
+  return nullptr;
+}
+
+herr_t FreeFileImage(void * /*ptr*/, H5FD_file_image_op_t /*op*/, void * /*udata*/)
+{
+  return 0;
+}
+
+void *CopyFileImageData(void *udata)
+{
+  return new FileImage(*static_cast<FileImage *>(udata));
+}
+
+herr_t FreeFileImageData(void *udata)
+{
+  delete static_cast<FileImage *>(udata);
+  return 0;
+}
+
+} // namespace
+
+hsize_t GetAutoChunkSize(hsize_t numRows, std::size_t rowSize)
+{
+  // sized for the initial rows plus the expected growth from later appends,
+  // rounded up to a power of two and clamped to [CHUNK_MIN_BYTES, CHUNK_MAX_BYTES]
+  const hsize_t minRows = CHUNK_MIN_BYTES / rowSize;
+  const hsize_t maxRows = CHUNK_MAX_BYTES / rowSize;
+
+  hsize_t chunkSize = minRows;
+  while(chunkSize < numRows * CHUNK_EXPECTED_GROWTH && chunkSize < maxRows)
+  {
+    chunkSize *= 2;
+  }
+
+  return chunkSize;
+}
+
+H5::DSetCreatPropList GetCreatePropList(const CreationOptions &options, hsize_t numRows, std::size_t rowSize)
+{
+  H5::DSetCreatPropList dsetPropList;
+
+  hsize_t chunkSize = options.chunkSize == 0 ? GetAutoChunkSize(numRows, rowSize) : options.chunkSize;
+  // note: layout is set to H5D_CHUNKED automatically.
+  dsetPropList.setChunk(1, &chunkSize);
+
+  // shuffle must come before deflate in the filter pipeline
+  if(options.shuffle)
+  {
+    dsetPropList.setShuffle();
+  }
+  if(options.deflateLevel >= 0)
+  {
+    dsetPropList.setDeflate(options.deflateLevel);
+  }
+
+  return dsetPropList;
+}
+
+H5::CompType GetCompoundFileType(bool is64Bit)
+{
+  const auto &intType  = is64Bit ? H5::PredType::STD_I64LE : H5::PredType::STD_I32LE;
+  const size_t intSize = intType.getSize();
+
+  H5::CompType compType(2 * intSize + sizeof(hobj_ref_t));
+  compType.insertMember(MEMBERNAME_START, 0, intType);
+  compType.insertMember(MEMBERNAME_COUNT, intSize, intType);
+  compType.insertMember(MEMBERNAME_REF, 2 * intSize, H5::PredType::STD_REF_OBJ);
+
+  return compType;
+}
+
+bool CheckCompoundSchema(const H5::DataSet &dataSet)
+{
+  if(dataSet.getTypeClass() != H5T_COMPOUND)
+  {
+    throw CompoundError(CompoundError::Kind::InvalidType, "Referenced HDF5 dataset has not compound type.");
+  }
+  H5::CompType compType(dataSet);
+  if(compType.getNmembers() != MEMBERNUMBER)
+  {
+    throw CompoundError(CompoundError::Kind::InvalidType,
+                        "Referenced HDF5 compound has not {} members."_format(MEMBERNUMBER));
+  }
+
+  int memIndexStart = compType.getMemberIndex(MEMBERNAME_START);
+  int memIndexCount = compType.getMemberIndex(MEMBERNAME_COUNT);
+  int memIndexRef   = compType.getMemberIndex(MEMBERNAME_REF);
+  if((memIndexStart != MEMBERNAME_START_IDX) || (memIndexCount != MEMBERNAME_COUNT_IDX) ||
+     (memIndexRef != MEMBERNAME_REF_IDX))
+  {
+    throw CompoundError(CompoundError::Kind::InvalidType, "Referenced HDF5 compound member has wrong element order.");
+  }
+
+  const bool is64Bit  = compType.getMemberDataType(memIndexStart) == H5::PredType::STD_I64LE;
+  const auto &intType = is64Bit ? H5::PredType::STD_I64LE : H5::PredType::STD_I32LE;
+  if(!(compType.getMemberDataType(memIndexStart) == intType) ||
+     !(compType.getMemberDataType(memIndexCount) == intType) ||
+     !(compType.getMemberDataType(memIndexRef) == H5::PredType::STD_REF_OBJ))
+  {
+    throw CompoundError(CompoundError::Kind::InvalidType, "Referenced HDF5 compound member has wrong type.");
+  }
+
+  return is64Bit;
+}
+
+H5::CompType GetCompoundFileTypeForAppend(const H5::Group &loc, const std::string &name, bool wide, bool needs64Bit)
+{
+  if(!loc.exists(name))
+  {
+    return GetCompoundFileType(wide || needs64Bit);
+  }
+
+  const bool is64Bit = CheckCompoundSchema(loc.openDataSet(name));
+  if(!is64Bit && needs64Bit)
+  {
+    throw CompoundError(CompoundError::Kind::OutOfRange,
+                        "Existing dataset {} has 32bit members, the offsets or sizes do not fit."_format(name));
+  }
+
+  return GetCompoundFileType(is64Bit);
+}
+
+bool Needs64Bit(const IntColumn &column, std::size_t numRows)
+{
+  if(!column.is64Bit)
+  {
+    return false;
+  }
+
+  auto values = static_cast<const int64_t *>(column.data);
+  return std::any_of(values, values + numRows, [](int64_t value) {
+    return value < std::numeric_limits<int32_t>::min() || value > std::numeric_limits<int32_t>::max();
+  });
+}
+
+unsigned int GetSuperblockVersion(const H5::H5Location &loc)
+{
+  hid_t fileId = H5Iget_file_id(loc.getId());
+  if(fileId < 0)
+  {
+    throw CompoundError(CompoundError::Kind::HDF5, "Could not get the file of the HDF5 object.");
+  }
+
+  H5F_info2_t fileInfo;
+  const herr_t status = H5Fget_info2(fileId, &fileInfo);
+  H5Fclose(fileId);
+  if(status < 0)
+  {
+    throw CompoundError(CompoundError::Kind::HDF5, "Could not query the HDF5 file info.");
+  }
+
+  return fileInfo.super.version;
+}
+
+bool ApplyFileFormat(const H5::H5Location &loc, LatestFormat format)
+{
+  if(format == LatestFormat::Keep)
+  {
+    return false;
+  }
+
+  // superblock version 3 was introduced with HDF5 1.10 together with the new chunk indexes
+  const bool latest = format == LatestFormat::Always || (format == LatestFormat::IfCompatible &&
+                                                         GetSuperblockVersion(loc) >= 3);
+
+  hid_t fileId = H5Iget_file_id(loc.getId());
+  if(fileId < 0)
+  {
+    throw CompoundError(CompoundError::Kind::HDF5, "Could not get the file of the HDF5 object.");
+  }
+
+  const herr_t status =
+      H5Fset_libver_bounds(fileId, latest ? H5F_LIBVER_LATEST : H5F_LIBVER_EARLIEST, H5F_LIBVER_LATEST);
+  H5Fclose(fileId);
+  if(status < 0)
+  {
+    throw CompoundError(CompoundError::Kind::HDF5, "Could not set the format version bounds of the HDF5 file.");
+  }
+
+  return latest;
+}
+
+std::string GetChunkIndexName(const H5::DataSet &dataSet)
+{
+  if(dataSet.getCreatePlist().getLayout() != H5D_CHUNKED)
+  {
+    return {};
+  }
+
+  H5D_chunk_index_t indexType;
+  if(H5Dget_chunk_index_type(dataSet.getId(), &indexType) < 0)
+  {
+    throw CompoundError(CompoundError::Kind::HDF5, "Could not query the chunk index of the HDF5 dataset.");
+  }
+
+  switch(indexType)
+  {
+  case H5D_CHUNK_IDX_BTREE:
+    return "v1 B-tree";
+  case H5D_CHUNK_IDX_SINGLE:
+    return "single chunk";
+  case H5D_CHUNK_IDX_NONE:
+    return "implicit";
+  case H5D_CHUNK_IDX_FARRAY:
+    return "fixed array";
+  case H5D_CHUNK_IDX_EARRAY:
+    return "extensible array";
+  case H5D_CHUNK_IDX_BT2:
+    return "v2 B-tree";
+  default:
+    return "unknown";
+  }
+}
+
+hsize_t GetAppendableSize(const H5::Group &loc, const std::string &name)
+{
+  if(!loc.exists(name))
+  {
+    return 0;
+  }
+
+  H5::DataSet dataSet = loc.openDataSet(name);
+  if(dataSet.getCreatePlist().getLayout() != H5D_CHUNKED)
+  {
+    throw CompoundError(CompoundError::Kind::HDF5,
+                        "Existing dataset {} is not chunked. Can not append new data."_format(name));
+  }
+
+  return GetNumRows(dataSet);
+}
+
+hsize_t GetCapacity(const H5::DataSet &dataSet)
+{
+  const auto numPoints = dataSet.getSpace().getSelectNpoints();
+
+  return numPoints > 0 ? static_cast<hsize_t>(numPoints) : 0;
+}
+
+bool FinalizeDataSet(const H5::DataSet &dataSet)
+{
+  hsize_t numRows = 0;
+  if(!ReadNumRowsAttribute(dataSet, numRows))
+  {
+    return false;
+  }
+
+  if(H5Dset_extent(dataSet.getId(), &numRows) < 0)
+  {
+    throw CompoundError(CompoundError::Kind::HDF5, "Could not trim the HDF5 dataset to its rows.");
+  }
+  dataSet.removeAttr(ATTRIBUTE_NUM_ROWS);
+
+  return true;
+}
+
+std::size_t FinalizeFile(const H5::H5File &file)
+{
+  // H5L_info_t follows the API version the library is built with, only the link type is used
+  std::vector<std::string> paths;
+  auto collect = [](hid_t, const char *name, const H5L_info_t *info, void *data) -> herr_t {
+    if(info->type == H5L_TYPE_HARD)
+    {
+      static_cast<std::vector<std::string> *>(data)->push_back(name);
+    }
+    return 0;
+  };
+
+  if(H5Lvisit(file.getId(), H5_INDEX_NAME, H5_ITER_NATIVE, collect, &paths) < 0)
+  {
+    throw CompoundError(CompoundError::Kind::HDF5, "Could not visit the objects of the HDF5 file.");
+  }
+
+  std::size_t numFinalized = 0;
+  for(const auto &path : paths)
+  {
+    if(file.childObjType(path) == H5O_TYPE_DATASET && FinalizeDataSet(file.openDataSet(path)))
+    {
+      numFinalized++;
+    }
+  }
+
+  return numFinalized;
+}
+
+void AppendToDataSet(const H5::Group &loc, const std::string &name, const H5::DataType &memType,
+                     const H5::DataType &fileType, const void *data, hsize_t numRows, const CreationOptions &options)
+{
+  auto rows = ExtendDataSet(loc, name, fileType, numRows, options);
+
+  try
+  {
+    if(numRows > 0)
+    {
+      rows.dataSet.write(data, memType, rows.memDataSpace, rows.fileDataSpace);
+    }
+    FinishAppend(rows);
+  }
+  catch(...)
+  {
+    RollbackAppend(loc, name, rows);
+    throw;
+  }
+}
+
+void AppendCompoundRows(const H5::Group &loc, const std::string &name, const H5::CompType &fileType,
+                        const IntColumn &offsets, const IntColumn &sizes, const std::vector<hobj_ref_t> &refs,
+                        const CreationOptions &options, Stats &stats)
+{
+  const hsize_t numRows = refs.size();
+
+  auto rows = ExtendDataSet(loc, name, fileType, numRows, options);
+  if(numRows == 0)
+  {
+    FinishAppend(rows);
+    return;
+  }
+
+  try
+  {
+    const hsize_t fileFirst = rows.numRows - numRows;
+
+    // rows [chunkedFirst, chunkedLast) fill whole chunks
+    hsize_t chunkedFirst = fileFirst;
+    hsize_t chunkedLast  = fileFirst;
+    hsize_t chunkSize    = 0;
+    std::vector<ChunkFilter> filters;
+    if(options.directChunks && GetDirectChunkFilters(rows.dataSet, fileType, filters))
+    {
+      rows.dataSet.getCreatePlist().getChunk(1, &chunkSize);
+      chunkedFirst = (fileFirst + chunkSize - 1) / chunkSize * chunkSize;
+      chunkedLast  = std::max(chunkedFirst, (fileFirst + numRows) / chunkSize * chunkSize);
+    }
+
+    // writes rows [begin, end) member by member
+    auto writeRows = [&](hsize_t begin, hsize_t end) {
+      if(begin >= end)
+      {
+        return;
+      }
+
+      hsize_t count    = end - begin;
+      hsize_t memFirst = begin - fileFirst;
+      rows.fileDataSpace.selectHyperslab(H5S_SELECT_SET, &count, &begin);
+      rows.memDataSpace.selectHyperslab(H5S_SELECT_SET, &count, &memFirst);
+
+      auto writeMember = [&](const void *data, const std::string &memberName, const H5::PredType &type) {
+        rows.dataSet.write(data, GetMemberType(memberName, type), rows.memDataSpace, rows.fileDataSpace);
+      };
+
+      writeMember(offsets.data, MEMBERNAME_START, GetMemoryType(offsets.is64Bit));
+      writeMember(sizes.data, MEMBERNAME_COUNT, GetMemoryType(sizes.is64Bit));
+      writeMember(refs.data(), MEMBERNAME_REF, H5::PredType::STD_REF_OBJ);
+    };
+
+    if(chunkedFirst < chunkedLast)
+    {
+      writeRows(fileFirst, chunkedFirst);
+
+      {
+        PhaseTimer timer(stats, Stats::Phase::WriteCompoundChunks);
+        const auto numBytes = WriteFullChunks(rows.dataSet, offsets, sizes, refs.data(), chunkedFirst - fileFirst,
+                                              chunkedFirst, chunkedLast - chunkedFirst, chunkSize, fileType.getSize(),
+                                              filters, options.numThreads);
+        timer.Add(chunkedLast - chunkedFirst, numBytes);
+      }
+
+      writeRows(chunkedLast, fileFirst + numRows);
+    }
+    else
+    {
+      writeRows(fileFirst, fileFirst + numRows);
+    }
+
+    FinishAppend(rows);
+  }
+  catch(...)
+  {
+    RollbackAppend(loc, name, rows);
+    throw;
+  }
+}
+
+AppendResult AppendRows(const H5::H5File &file, const std::string &path, const CreationOptions &options,
+                        const CompoundRows &rows, bool useRefCache, Stats &stats)
+{
+  // only the references need a buffer
+  std::vector<hobj_ref_t> refs(rows.numRows);
+  ReferenceCache refCache(file, useRefCache);
+  {
+    PhaseTimer timer(stats, Stats::Phase::WriteCompoundReferences);
+    for(size_t i = 0; i < rows.numRows; i++)
+    {
+      refs[i] = refCache.Get(rows.refs[i]);
+    }
+    timer.Add(rows.numRows, 0);
+  }
+
+  PhaseTimer timer(stats, Stats::Phase::WriteCompoundAppend);
+  const bool needs64Bit = Needs64Bit(rows.offsets, rows.numRows) || Needs64Bit(rows.sizes, rows.numRows);
+  auto fileType         = GetCompoundFileTypeForAppend(file, path, options.wideIndices, needs64Bit);
+  AppendCompoundRows(file, path, fileType, rows.offsets, rows.sizes, refs, options, stats);
+  timer.Add(rows.numRows, rows.numRows * fileType.getSize());
+
+  return {refCache.GetHits(), refCache.GetMisses()};
+}
+
+int64_t ReadLastIndex(const H5::Group &loc, const std::string &name, hsize_t numRows)
+{
+  int64_t value = 0;
+  if(numRows == 0)
+  {
+    return value;
+  }
+
+  H5::DataSet dataSet = loc.openDataSet(name);
+  if(dataSet.getTypeClass() != H5T_INTEGER)
+  {
+    throw CompoundError(CompoundError::Kind::InvalidType, "Dataset {} must have an integer type."_format(name));
+  }
+
+  hsize_t count               = 1;
+  hsize_t last                = numRows - 1;
+  H5::DataSpace fileDataSpace = dataSet.getSpace();
+  fileDataSpace.selectHyperslab(H5S_SELECT_SET, &count, &last);
+  H5::DataSpace memDataSpace(1, &count, nullptr);
+  dataSet.read(&value, H5::PredType::NATIVE_INT64, memDataSpace, fileDataSpace);
+
+  return value;
+}
+
+std::pair<int64_t, int64_t> GetIntegerRange(const H5::Group &loc, const std::string &name,
+                                            const H5::IntType &fallback)
+{
+  H5::IntType intType = loc.exists(name) ? H5::IntType(loc.openDataSet(name)) : fallback;
+
+  const bool isSigned = intType.getSign() != H5T_SGN_NONE;
+  const auto numBits  = intType.getSize() * 8 - (isSigned ? 1 : 0);
+  if(numBits >= 63)
+  {
+    return {isSigned ? std::numeric_limits<int64_t>::min() : 0, std::numeric_limits<int64_t>::max()};
+  }
+
+  const int64_t max = (int64_t(1) << numBits) - 1;
+
+  return {isSigned ? -max - 1 : 0, max};
+}
+
+void TruncateDataSet(const H5::Group &loc, const std::string &name, hsize_t numRows)
+{
+  H5::DataSet dataSet = loc.openDataSet(name);
+
+  hsize_t oldRows = 0;
+  if(ReadNumRowsAttribute(dataSet, oldRows))
+  {
+    WriteNumRowsAttribute(dataSet, std::min(numRows, oldRows));
+    return;
+  }
+
+  if(numRows < GetCapacity(dataSet) && H5Dset_extent(dataSet.getId(), &numRows) < 0)
+  {
+    throw CompoundError(CompoundError::Kind::HDF5, "Could not truncate the HDF5 dataset {}."_format(name));
+  }
+}
+
+H5::H5File OpenFileImage(const void *data, std::size_t size)
+{
+  if(data == nullptr || size == 0)
+  {
+    throw CompoundError(CompoundError::Kind::InvalidType, "The file image is empty.");
+  }
+
+  // the core driver identifies open files by name, an existing file of that name is an error
+  static std::atomic<uint64_t> imageCount{0};
+  const auto name = "ipnwb_file_image_{}"_format(imageCount++);
+
+  FileImage image{data, size};
+  H5FD_file_image_callbacks_t callbacks{};
+  callbacks.image_malloc  = AllocateFileImage;
+  callbacks.image_memcpy  = CopyFileImage;
+  callbacks.image_realloc = ResizeFileImage;
+  callbacks.image_free    = FreeFileImage;
+  callbacks.udata_copy    = CopyFileImageData;
+  callbacks.udata_free    = FreeFileImageData;
+  callbacks.udata         = &image;
+
+  H5::FileAccPropList fapl;
+  fapl.setCore(size, false);
+  if(H5Pset_file_image_callbacks(fapl.getId(), &callbacks) < 0 ||
+     H5Pset_file_image(fapl.getId(), const_cast<void *>(data), size) < 0)
+  {
+    throw CompoundError(CompoundError::Kind::HDF5, "Could not set the file image.");
+  }
+
+  return H5::H5File(name, H5F_ACC_RDONLY, H5::FileCreatPropList::DEFAULT, fapl);
+}
+
+H5::DataSet OpenCompound(const H5::H5File &file, const std::string &path, bool &is64Bit)
+{
+  if(!file.exists(path))
+  {
+    throw CompoundError(CompoundError::Kind::InvalidType, "HDF5 data not present at given path.");
+  }
+
+  H5::DataSet dataSet = file.openDataSet(path);
+  is64Bit             = CheckCompoundSchema(dataSet);
+
+  return dataSet;
+}
+
+hsize_t GetNumRows(const H5::DataSet &dataSet)
+{
+  hsize_t numRows = 0;
+  if(ReadNumRowsAttribute(dataSet, numRows))
+  {
+    return numRows;
+  }
+
+  return GetCapacity(dataSet);
+}
+
+void ReadMember(const H5::DataSet &dataSet, void *buf, const std::string &name, const H5::PredType &type,
+                hsize_t first, hsize_t count)
+{
+  if(count == 0)
+  {
+    return;
+  }
+
+  H5::DataSpace fileDataSpace = dataSet.getSpace();
+  fileDataSpace.selectHyperslab(H5S_SELECT_SET, &count, &first);
+  H5::DataSpace memDataSpace(1, &count, nullptr);
+
+  // each member is read on its own, so it can go straight into the caller's memory
+  dataSet.read(buf, GetMemberType(name, type), memDataSpace, fileDataSpace);
+}
+
+void ReadIntMember(const H5::DataSet &dataSet, const IntBuffer &buf, const std::string &name, hsize_t first,
+                   hsize_t count)
+{
+  ReadMember(dataSet, buf.data, name, GetMemoryType(buf.is64Bit), first, count);
+}
+
+std::vector<hobj_ref_t> ReadReferences(const H5::DataSet &dataSet, hsize_t first, hsize_t count)
+{
+  std::vector<hobj_ref_t> refs(count);
+  ReadMember(dataSet, refs.data(), MEMBERNAME_REF, H5::PredType::STD_REF_OBJ, first, count);
+
+  return refs;
+}
+
+ResolvedReferences ResolveReferences(const H5::H5File &file, const std::vector<hobj_ref_t> &refs,
+                                     DereferenceCache &cache, bool unique)
+{
+  ResolvedReferences resolved;
+
+  if(!unique)
+  {
+    resolved.paths.reserve(refs.size());
+    for(const auto &ref : refs)
+    {
+      resolved.paths.push_back(cache.Get(file, ref));
+    }
+
+    return resolved;
+  }
+
+  std::unordered_map<hobj_ref_t, int32_t> uniqueRefs;
+  resolved.indices.reserve(refs.size());
+  for(const auto &ref : refs)
+  {
+    const auto [it, inserted] = uniqueRefs.emplace(ref, static_cast<int32_t>(uniqueRefs.size()));
+    if(inserted)
+    {
+      resolved.paths.push_back(cache.Get(file, ref));
+    }
+    resolved.indices.push_back(it->second);
+  }
+
+  return resolved;
+}
+
+CompoundInfo GetCompoundInfo(const H5::DataSet &dataSet)
+{
+  CompoundInfo info;
+
+  info.is64Bit = CheckCompoundSchema(dataSet);
+  H5::CompType compType(dataSet);
+
+  info.numRows     = GetNumRows(dataSet);
+  info.capacity    = GetCapacity(dataSet);
+  info.rowSize     = compType.getSize();
+  info.storageSize = dataSet.getStorageSize();
+
+  const auto createPropList = dataSet.getCreatePlist();
+  if(createPropList.getLayout() == H5D_CHUNKED)
+  {
+    createPropList.getChunk(1, &info.chunkSize);
+    info.chunkIndex = GetChunkIndexName(dataSet);
+  }
+
+  for(int i = 0; i < createPropList.getNfilters(); i++)
+  {
+    unsigned int flags, filterConfig;
+    unsigned int values[8] = {};
+    size_t numValues       = 8;
+    char name[64]          = {};
+    const auto filter      = createPropList.getFilter(i, flags, numValues, values, sizeof(name), name, filterConfig);
+
+    if(filter == H5Z_FILTER_DEFLATE && numValues > 0)
+    {
+      info.deflateLevel = static_cast<int>(values[0]);
+    }
+    else if(filter == H5Z_FILTER_SHUFFLE)
+    {
+      info.shuffle = true;
+    }
+    info.filters += (name[0] != '\0' ? std::string(name) : std::to_string(filter)) + ";";
+  }
+
+  const auto numMembers = static_cast<unsigned int>(compType.getNmembers());
+  for(unsigned int i = 0; i < numMembers; i++)
+  {
+    const auto memberType = compType.getMemberDataType(i);
+
+    CompoundInfo::Member member;
+    member.name   = compType.getMemberName(i);
+    member.offset = compType.getMemberOffset(i);
+    member.size   = memberType.getSize();
+    member.type   = memberType == H5::PredType::STD_REF_OBJ ? "reference" : "int" + std::to_string(8 * member.size);
+    info.members.push_back(std::move(member));
+  }
+
+  return info;
+}
+
+} // namespace CompoundEngine
@@ -0,0 +1,323 @@
+#pragma once
+
+#include "H5Cpp.h"
+#include "ReferenceCache.h"
+#include "Stats.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/// @brief Reading and writing the compound dataset of the NWB epochs table
+///
+/// The dataset has one row per referenced timeseries range with the members
+/// idx_start, count and timeseries, an object reference. Offset and size are
+/// 32bit or 64bit integers.
+///
+/// Nothing in here depends on Igor Pro, the data is passed as plain pointers
+/// and strings. Locking is left to the caller. Errors are reported with
+/// CompoundError, errors of the HDF5 library with H5::Exception.
+namespace CompoundEngine
+{
+
+extern const std::string MEMBERNAME_START;
+extern const std::string MEMBERNAME_COUNT;
+extern const std::string MEMBERNAME_REF;
+
+// columns of the NWB epochs table
+extern const std::string COLUMN_ID;
+extern const std::string COLUMN_START_TIME;
+extern const std::string COLUMN_STOP_TIME;
+extern const std::string COLUMN_TAGS;
+extern const std::string COLUMN_TAGS_INDEX;
+extern const std::string COLUMN_TIMESERIES;
+extern const std::string COLUMN_TIMESERIES_INDEX;
+extern const std::string COLUMN_TREELEVEL;
+
+/// @brief Attribute with the number of rows of a dataset grown in capacity steps
+///
+/// Datasets created or appended with CreationOptions::growCapacity are
+/// extended geometrically, so most appends only write the rows and this
+/// attribute instead of changing the extent. The rows after the stored number
+/// are unused. Readers of this library honor the attribute, FinalizeDataSet()
+/// trims the dataset to its rows and removes it so that other readers see the
+/// same rows.
+extern const std::string ATTRIBUTE_NUM_ROWS;
+
+/// size of a row of the compound with 64bit members
+constexpr std::size_t COMPOUND_MAX_ROW_SIZE = 2 * sizeof(int64_t) + sizeof(hobj_ref_t);
+
+/// @brief Error of the compound engine
+class CompoundError : public std::runtime_error
+{
+public:
+  enum class Kind
+  {
+    InvalidType, ///< the dataset or the input does not have the expected type or shape
+    HDF5,        ///< the dataset can not be used, e.g. it is not chunked
+    OutOfRange   ///< a value does not fit into the dataset
+  };
+
+  CompoundError(Kind kind, const std::string &msg) : std::runtime_error(msg), m_kind(kind)
+  {
+  }
+
+  Kind GetKind() const noexcept
+  {
+    return m_kind;
+  }
+
+private:
+  Kind m_kind;
+};
+
+/// Version bounds for the objects created in a file, see ApplyFileFormat()
+enum class LatestFormat
+{
+  Keep,         ///< leave the version bounds of the file as they are
+  Never,        ///< earliest possible format, readable by HDF5 1.8
+  IfCompatible, ///< latest format only for files which already need HDF5 1.10 or later
+  Always        ///< latest format, the file needs HDF5 1.10 or later
+};
+
+/// Options of new datasets and of appending to them
+struct CreationOptions
+{
+  hsize_t chunkSize         = 0;  ///< rows per chunk, 0 selects the automatic chunk size
+  int deflateLevel          = -1; ///< deflate compression level, -1 disables compression
+  bool shuffle              = false;
+  bool wideIndices          = false; ///< 64bit offset and size members, also used if the values do not fit into 32bit
+  LatestFormat latestFormat = LatestFormat::Keep;
+  bool growCapacity         = false; ///< see ATTRIBUTE_NUM_ROWS, also converts existing datasets
+  bool directChunks         = true;  ///< write full chunks with H5Dwrite_chunk, see AppendCompoundRows()
+  unsigned int numThreads   = 0;     ///< threads compressing full chunks, 0 compresses on the calling thread
+
+  bool operator==(const CreationOptions &other) const
+  {
+    return chunkSize == other.chunkSize && deflateLevel == other.deflateLevel && shuffle == other.shuffle &&
+           wideIndices == other.wideIndices && latestFormat == other.latestFormat &&
+           growCapacity == other.growCapacity && directChunks == other.directChunks && numThreads == other.numThreads;
+  }
+
+  bool operator!=(const CreationOptions &other) const
+  {
+    return !(*this == other);
+  }
+};
+
+/// Read-only span of 32bit or 64bit integers
+struct IntColumn
+{
+  const void *data = nullptr;
+  bool is64Bit     = false;
+
+  int64_t operator[](std::size_t i) const
+  {
+    return is64Bit ? static_cast<const int64_t *>(data)[i] : static_cast<const int32_t *>(data)[i];
+  }
+};
+
+/// Writable span of 32bit or 64bit integers
+struct IntBuffer
+{
+  void *data   = nullptr;
+  bool is64Bit = false;
+};
+
+/// Rows of the compound dataset, refs are the paths of the referenced objects
+struct CompoundRows
+{
+  std::size_t numRows = 0;
+  IntColumn offsets;
+  IntColumn sizes;
+  std::vector<std::string_view> refs;
+};
+
+struct AppendResult
+{
+  std::size_t refCacheHits   = 0;
+  std::size_t refCacheMisses = 0;
+};
+
+/// Paths of referenced objects, see ResolveReferences()
+struct ResolvedReferences
+{
+  std::vector<std::string> paths;
+  std::vector<int32_t> indices; ///< index into paths for every reference, only filled for unique paths
+};
+
+/// Layout of a compound dataset, see GetCompoundInfo()
+struct CompoundInfo
+{
+  struct Member
+  {
+    std::string name;
+    std::size_t offset = 0;
+    std::size_t size   = 0;
+    std::string type; ///< "reference" or "int" followed by the number of bits
+  };
+
+  hsize_t numRows     = 0;
+  hsize_t capacity    = 0; ///< rows the dataset has space for, see ATTRIBUTE_NUM_ROWS
+  std::size_t rowSize = 0;
+  bool is64Bit        = false;
+  hsize_t storageSize = 0;
+  hsize_t chunkSize   = 0; ///< 0 for datasets which are not chunked
+  int deflateLevel    = -1;
+  bool shuffle        = false;
+  std::string filters;    ///< filter names, separated by ";"
+  std::string chunkIndex; ///< see GetChunkIndexName()
+  std::vector<Member> members;
+};
+
+// Schema
+
+/// Return the number of rows per chunk for a new dataset with numRows rows of rowSize bytes
+hsize_t GetAutoChunkSize(hsize_t numRows, std::size_t rowSize);
+
+/// Return the creation property list for a new dataset
+H5::DSetCreatPropList GetCreatePropList(const CreationOptions &options, hsize_t numRows, std::size_t rowSize);
+
+/// Return the file type of the compound, with 32bit or 64bit members for offset and size
+H5::CompType GetCompoundFileType(bool is64Bit);
+
+/// Check that the dataset has the compound type written by this engine
+///
+/// @return true if offset and size are 64bit members, false if they are 32bit members
+bool CheckCompoundSchema(const H5::DataSet &dataSet);
+
+/// Return the file type for appending rows to the compound dataset `name`
+///
+/// Existing datasets keep their member size, new ones use 64bit members if
+/// requested or if `needs64Bit` is set.
+H5::CompType GetCompoundFileTypeForAppend(const H5::Group &loc, const std::string &name, bool wide, bool needs64Bit);
+
+/// Return true if any of the first `numRows` values of the column is outside the 32bit range
+bool Needs64Bit(const IntColumn &column, std::size_t numRows);
+
+// File format
+
+/// Return the superblock version of the file containing `loc`
+///
+/// Version 3 and later superblocks need HDF5 1.10 or later to open the file.
+unsigned int GetSuperblockVersion(const H5::H5Location &loc);
+
+/// Set the version bounds for objects created in the file containing `loc`
+///
+/// With the latest format new datasets with an unlimited dimension get an
+/// extensible array chunk index instead of a version 1 B-tree, which makes
+/// appends and chunk lookups independent of the dataset size. HDF5 1.8 can
+/// not read these datasets. HDF5 does not upgrade the superblock of an existing
+/// file though, so older readers would still open the file and only fail on
+/// the new datasets. LatestFormat::IfCompatible therefore uses the latest
+/// format only if the superblock already requires HDF5 1.10.
+///
+/// @return true if new objects are created in the latest format
+bool ApplyFileFormat(const H5::H5Location &loc, LatestFormat format);
+
+/// Return the name of the chunk index of the dataset, empty if it is not chunked
+std::string GetChunkIndexName(const H5::DataSet &dataSet);
+
+// Appending
+
+/// Return the number of rows of the existing 1D dataset `name`, 0 if it does not exist
+///
+/// Throws if the dataset can not be appended to.
+hsize_t GetAppendableSize(const H5::Group &loc, const std::string &name);
+
+/// Return the number of rows the 1D dataset has space for, larger than its rows if grown in capacity steps
+hsize_t GetCapacity(const H5::DataSet &dataSet);
+
+/// Trim a dataset grown in capacity steps to its rows and remove ATTRIBUTE_NUM_ROWS
+///
+/// @return true if the dataset was grown in capacity steps
+bool FinalizeDataSet(const H5::DataSet &dataSet);
+
+/// Finalize all datasets of the file which were grown in capacity steps
+///
+/// @return number of finalized datasets
+std::size_t FinalizeFile(const H5::H5File &file);
+
+/// Append `numRows` rows to the 1D dataset `name`, creating it with `fileType` if it does not exist
+///
+/// If the rows can not be written the dataset is left with its old rows, or removed if it was created.
+void AppendToDataSet(const H5::Group &loc, const std::string &name, const H5::DataType &memType,
+                     const H5::DataType &fileType, const void *data, hsize_t numRows, const CreationOptions &options);
+
+/// Append rows to the compound dataset `name`, creating it with `fileType` if it does not exist
+///
+/// Rows filling whole chunks are assembled in the file layout, shuffled and
+/// compressed here and written with H5Dwrite_chunk, bypassing the type
+/// conversion and filter pipeline of HDF5. This needs a little-endian host and
+/// a dataset without filters other than shuffle and deflate. The remaining rows
+/// are written member by member, straight from the caller's memory. The direct
+/// writes are recorded in `stats`. If the rows can not be written the dataset
+/// is left with its old rows, or removed if it was created.
+void AppendCompoundRows(const H5::Group &loc, const std::string &name, const H5::CompType &fileType,
+                        const IntColumn &offsets, const IntColumn &sizes, const std::vector<hobj_ref_t> &refs,
+                        const CreationOptions &options, Stats &stats);
+
+/// Resolve the paths of the rows and append them to the compound dataset `path`, creating it if necessary
+///
+/// The phases are recorded in `stats`.
+AppendResult AppendRows(const H5::H5File &file, const std::string &path, const CreationOptions &options,
+                        const CompoundRows &rows, bool useRefCache, Stats &stats);
+
+/// Return the last element of the integer dataset `name` with `numRows` rows, 0 if it is empty
+int64_t ReadLastIndex(const H5::Group &loc, const std::string &name, hsize_t numRows);
+
+/// Return the smallest and largest value the integer type of the dataset `name` can hold
+///
+/// `fallback` is used if the dataset does not exist, the range is clamped to 64bit signed integers.
+std::pair<int64_t, int64_t> GetIntegerRange(const H5::Group &loc, const std::string &name,
+                                            const H5::IntType &fallback);
+
+/// Remove the rows after the first `numRows` rows of the 1D dataset `name`
+///
+/// Used to revert appends, `numRows` must not be larger than the rows of the
+/// dataset. Datasets grown in capacity steps only get ATTRIBUTE_NUM_ROWS updated.
+void TruncateDataSet(const H5::Group &loc, const std::string &name, hsize_t numRows);
+
+// Reading
+
+/// Open the HDF5 file image in `data` read-only with the core driver
+///
+/// The image is used in place, neither copied nor written to disk. It must
+/// stay alive and unchanged until the file and all objects opened from it are
+/// closed.
+H5::H5File OpenFileImage(const void *data, std::size_t size);
+
+/// Open the compound dataset `path` and check its schema
+///
+/// @param is64Bit set to true if offset and size are 64bit members
+H5::DataSet OpenCompound(const H5::H5File &file, const std::string &path, bool &is64Bit);
+
+/// Return the number of rows of a 1D dataset, see ATTRIBUTE_NUM_ROWS
+hsize_t GetNumRows(const H5::DataSet &dataSet);
+
+/// Read the member `name` of `count` rows starting at `first` into `buf`, HDF5 converts it to `type`
+void ReadMember(const H5::DataSet &dataSet, void *buf, const std::string &name, const H5::PredType &type,
+                hsize_t first, hsize_t count);
+
+/// Read the offsets or sizes of `count` rows starting at `first`
+void ReadIntMember(const H5::DataSet &dataSet, const IntBuffer &buf, const std::string &name, hsize_t first,
+                   hsize_t count);
+
+/// Return the object references of `count` rows starting at `first`
+std::vector<hobj_ref_t> ReadReferences(const H5::DataSet &dataSet, hsize_t first, hsize_t count);
+
+/// Resolve object references to the paths of the referenced objects
+///
+/// @param unique when true every distinct path is returned once, in order of
+///               first appearance, and the indices map the references to it
+ResolvedReferences ResolveReferences(const H5::H5File &file, const std::vector<hobj_ref_t> &refs,
+                                     DereferenceCache &cache, bool unique);
+
+/// Return the layout of the compound dataset, only its header is read
+CompoundInfo GetCompoundInfo(const H5::DataSet &dataSet);
+
+} // namespace CompoundEngine
@@ -0,0 +1,80 @@
+#include "ReferenceCache.h"
+
+#include <memory>
+#include <utility>
+
+ReferenceCache::ReferenceCache(const H5::H5File &file, bool enabled) : m_file(file), m_enabled(enabled)
+{
+}
+
+hobj_ref_t ReferenceCache::Get(std::string_view path)
+{
+  if(m_enabled)
+  {
+    auto it = m_refs.find(path);
+    if(it != m_refs.end())
+    {
+      m_hits++;
+      return it->second;
+    }
+  }
+
+  m_misses++;
+
+  std::string name(path);
+  hobj_ref_t ref;
+  m_file.reference(&ref, name);
+
+  if(m_enabled)
+  {
+    m_refs.emplace(std::move(name), ref);
+  }
+
+  return ref;
+}
+
+std::size_t ReferenceCache::GetHits() const
+{
+  return m_hits;
+}
+
+std::size_t ReferenceCache::GetMisses() const
+{
+  return m_misses;
+}
+
+const std::string &DereferenceCache::Get(const H5::H5File &file, hobj_ref_t ref)
+{
+  auto it = m_names.find(ref);
+  if(it != m_names.end())
+  {
+    m_hits++;
+    return it->second;
+  }
+
+  m_misses++;
+
+  // dereferencing changes dset internally to a H5::Object, which is opened and requires a separate close
+  auto dset = std::make_shared<H5::DataSet>(file, &ref);
+  auto name = dset->getObjName();
+  H5Oclose(dset->getId());
+
+  return m_names.emplace(ref, std::move(name)).first->second;
+}
+
+void DereferenceCache::Clear()
+{
+  m_names.clear();
+  m_hits   = 0;
+  m_misses = 0;
+}
+
+std::size_t DereferenceCache::GetHits() const
+{
+  return m_hits;
+}
+
+std::size_t DereferenceCache::GetMisses() const
+{
+  return m_misses;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "H5Cpp.h"
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+/// @brief Resolves paths in a HDF5 file to object references
+///
+/// Each distinct path is resolved only once, as the epochs table references
+/// only a handful of distinct timeseries. The cache is only valid for the
+/// file it was created with.
+class ReferenceCache
+{
+public:
+  /// @param file    HDF5 file the references point into
+  /// @param enabled when false every lookup resolves the path again
+  explicit ReferenceCache(const H5::H5File &file, bool enabled = true);
+
+  /// Return the object reference of path
+  hobj_ref_t Get(std::string_view path);
+
+  std::size_t GetHits() const;
+  std::size_t GetMisses() const;
+
+private:
+  const H5::H5File &m_file;
+  bool m_enabled;
+  std::map<std::string, hobj_ref_t, std::less<>> m_refs;
+  std::size_t m_hits   = 0;
+  std::size_t m_misses = 0;
+};
+
+/// @brief Resolves object references in a HDF5 file to the path of the referenced object
+///
+/// The cache is keyed on the raw object reference, which is the address of the
+/// object in the file, so each distinct object is opened only once. The cache
+/// is only valid for the file the references were resolved with.
+class DereferenceCache
+{
+public:
+  /// Return the path of the object ref points to
+  const std::string &Get(const H5::H5File &file, hobj_ref_t ref);
+
+  void Clear();
+
+  std::size_t GetHits() const;
+  std::size_t GetMisses() const;
+
+private:
+  std::unordered_map<hobj_ref_t, std::string> m_names;
+  std::size_t m_hits   = 0;
+  std::size_t m_misses = 0;
+};
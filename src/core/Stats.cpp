@@ -0,0 +1,68 @@
+#include "Stats.h"
+
+std::string Stats::GetPhaseName(Phase phase)
+{
+  switch(phase)
+  {
+  case Phase::WriteCompound:
+    return "WriteCompound";
+  case Phase::WriteCompoundMarshal:
+    return "WriteCompound_marshal";
+  case Phase::WriteCompoundOpen:
+    return "WriteCompound_open";
+  case Phase::WriteCompoundReferences:
+    return "WriteCompound_references";
+  case Phase::WriteCompoundAppend:
+    return "WriteCompound_append";
+  case Phase::WriteCompoundChunks:
+    return "WriteCompound_chunks";
+  case Phase::ReadCompound:
+    return "ReadCompound";
+  case Phase::ReadCompoundOpen:
+    return "ReadCompound_open";
+  case Phase::ReadCompoundRead:
+    return "ReadCompound_read";
+  case Phase::ReadCompoundDereference:
+    return "ReadCompound_dereference";
+  case Phase::ReadCompoundWaves:
+    return "ReadCompound_waves";
+  case Phase::Count:
+    break;
+  }
+
+  return "unknown";
+}
+
+void Stats::Add(Phase phase, std::chrono::nanoseconds elapsed, uint64_t rows, uint64_t bytes)
+{
+  auto &counter = m_counters[static_cast<std::size_t>(phase)];
+
+  counter.calls.fetch_add(1, std::memory_order_relaxed);
+  counter.nanoseconds.fetch_add(static_cast<uint64_t>(elapsed.count()), std::memory_order_relaxed);
+  counter.rows.fetch_add(rows, std::memory_order_relaxed);
+  counter.bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+Stats::Snapshot Stats::Get(Phase phase) const
+{
+  const auto &counter = m_counters[static_cast<std::size_t>(phase)];
+
+  Snapshot snapshot;
+  snapshot.calls       = counter.calls.load(std::memory_order_relaxed);
+  snapshot.nanoseconds = counter.nanoseconds.load(std::memory_order_relaxed);
+  snapshot.rows        = counter.rows.load(std::memory_order_relaxed);
+  snapshot.bytes       = counter.bytes.load(std::memory_order_relaxed);
+
+  return snapshot;
+}
+
+void Stats::Reset()
+{
+  for(auto &counter : m_counters)
+  {
+    counter.calls.store(0, std::memory_order_relaxed);
+    counter.nanoseconds.store(0, std::memory_order_relaxed);
+    counter.rows.store(0, std::memory_order_relaxed);
+    counter.bytes.store(0, std::memory_order_relaxed);
+  }
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/// @brief Counters of the phases of IPNWB_WriteCompound and IPNWB_ReadCompound
+///
+/// Each phase records how often it ran, its accumulated wall time and the
+/// number of rows and bytes it processed. The counters are relaxed atomics,
+/// so recording is cheap and can happen from any thread.
+class Stats
+{
+public:
+  enum class Phase
+  {
+    WriteCompound,           ///< complete operation
+    WriteCompoundMarshal,    ///< reading the input waves
+    WriteCompoundOpen,       ///< opening the file or taking it from the pool
+    WriteCompoundReferences, ///< resolving the paths to object references
+    WriteCompoundAppend,     ///< extending the dataset and writing the rows
+    WriteCompoundChunks,     ///< writing full chunks directly, part of WriteCompoundAppend
+    ReadCompound,            ///< complete operation
+    ReadCompoundOpen,        ///< opening the file and checking the schema
+    ReadCompoundRead,        ///< reading the rows from the file
+    ReadCompoundDereference, ///< resolving the object references to paths
+    ReadCompoundWaves,       ///< creating and filling the output waves
+    Count
+  };
+
+  static constexpr std::size_t NUM_PHASES = static_cast<std::size_t>(Phase::Count);
+
+  struct Snapshot
+  {
+    uint64_t calls       = 0;
+    uint64_t nanoseconds = 0;
+    uint64_t rows        = 0;
+    uint64_t bytes       = 0;
+  };
+
+  /// Return the name of the phase, used as dimension label
+  static std::string GetPhaseName(Phase phase);
+
+  void Add(Phase phase, std::chrono::nanoseconds elapsed, uint64_t rows, uint64_t bytes);
+
+  Snapshot Get(Phase phase) const;
+
+  void Reset();
+
+private:
+  struct Counter
+  {
+    std::atomic<uint64_t> calls{0};
+    std::atomic<uint64_t> nanoseconds{0};
+    std::atomic<uint64_t> rows{0};
+    std::atomic<uint64_t> bytes{0};
+  };
+
+  std::array<Counter, NUM_PHASES> m_counters;
+};
+
+/// @brief Records the wall time of a phase from construction to destruction or Stop()
+class PhaseTimer
+{
+public:
+  PhaseTimer(Stats &stats, Stats::Phase phase) : m_stats(stats), m_phase(phase), m_start(Clock::now())
+  {
+  }
+
+  ~PhaseTimer()
+  {
+    Stop();
+  }
+
+  PhaseTimer(const PhaseTimer &) = delete;
+  PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+  /// Count rows and bytes processed in this phase
+  void Add(uint64_t rows, uint64_t bytes)
+  {
+    m_rows += rows;
+    m_bytes += bytes;
+  }
+
+  /// Record the phase now instead of on destruction
+  void Stop()
+  {
+    if(!m_stopped)
+    {
+      m_stopped = true;
+      m_stats.Add(m_phase, Clock::now() - m_start, m_rows, m_bytes);
+    }
+  }
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  Stats &m_stats;
+  Stats::Phase m_phase;
+  Clock::time_point m_start;
+  uint64_t m_rows  = 0;
+  uint64_t m_bytes = 0;
+  bool m_stopped   = false;
+};
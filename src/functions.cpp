@@ -12,9 +12,11 @@ XOPIORecResult RegisterFunction()
   XOPIORecParam funcIndex    = GetXOPItem(0); /* which function invoked ? */
   XOPIORecResult returnValue = NIL;
 
-  // switch (funcIndex)
-  //{
-
-  //}
+  switch(funcIndex)
+  {
+  case 0:
+    returnValue = (XOPIORecResult) IPNWB_GetStats;
+    break;
+  }
   return returnValue;
 }
@@ -3,3 +3,15 @@
 #include "XOPStandardHeaders.h" // Include ANSI headers, Mac headers, IgorXOP.h, XOP.h and XOPSupport.h
 
 XOPIORecResult RegisterFunction();
+
+// WAVE IPNWB_GetStats()
+#pragma pack(2) // All structures passed to Igor are two-byte aligned.
+struct IPNWB_GetStatsParams
+{
+  waveHndl result;
+};
+typedef struct IPNWB_GetStatsParams IPNWB_GetStatsParams;
+typedef struct IPNWB_GetStatsParams *IPNWB_GetStatsParamsPtr;
+#pragma pack() // Reset structure alignment to default.
+
+extern "C" int IPNWB_GetStats(IPNWB_GetStatsParamsPtr p);
@@ -0,0 +1,10 @@
+// autogenerated by xop-stub-generator.pl from interface.h
+resource 'XOPF' (1100) {
+	{
+		"IPNWB_GetStats",
+		F_UTIL | F_THREADSAFE | F_EXTERNAL,
+		WAVE_TYPE,
+		{
+		},
+	}
+};
@@ -1,34 +1,217 @@
 #include "mies-nwb2-compound-XOP_handler.h"
 
+#include "CompoundEngine.h"
 #include "CustomExceptions.h"
 #include "H5Cpp.h"
 #include "H5Exception.h"
 #include "Helpers.h"
 #include "Operations.h"
+#include "ReferenceCache.h"
 #include "xop_errors.h"
 #include <algorithm>
 #include <cstdint>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <tuple>
 #include <type_traits>
 #include <vector>
 
+using namespace CompoundEngine;
+
 namespace
 {
 using namespace fmt::literals;
 
-static const std::string MEMBERNAME_START = "idx_start";
-static const std::string MEMBERNAME_COUNT = "count";
-static const std::string MEMBERNAME_REF   = "timeseries";
-static const int MEMBERNUMBER             = 3;
-static const int MEMBERNAME_START_IDX     = 0;
-static const int MEMBERNAME_COUNT_IDX     = 1;
-static const int MEMBERNAME_REF_IDX       = 2;
+using StateLock = std::lock_guard<std::mutex>;
+
+// maximum number of files IPNWB_ReadCompound /CACHE keeps resolved references for
+static const size_t MAX_PERSISTENT_DEREFERENCE_CACHES = 32;
+
+// maximum number of threads IPNWB_Configure /THREADS starts for compressing chunks
+static const unsigned int MAX_COMPRESSION_THREADS = 64;
+
+/// @brief Return true if the HDF5 library serializes its API calls itself
+bool IsHDF5ThreadSafe()
+{
+  static const bool threadSafe = [] {
+    hbool_t result = false;
+    return H5is_library_threadsafe(&result) >= 0 && result;
+  }();
+
+  return threadSafe;
+}
+
+/// @brief Read the filter options requested with /COMP and /SHUF into `options`
+template <typename T>
+void ReadFilterOptions(T p, CreationOptions &options)
+{
+  if(p->COMPFlagEncountered)
+  {
+    options.deflateLevel = ConvertFromDouble<int>(p->compLevel, "/COMP must be an integer between 0 and 9.");
+    if(options.deflateLevel < 0 || options.deflateLevel > 9)
+    {
+      throw IgorException(kParameterOutOfRange, "/COMP must be an integer between 0 and 9.");
+    }
+
+    if(H5Zfilter_avail(H5Z_FILTER_DEFLATE) <= 0)
+    {
+      throw IgorException(ERR_HDF5, "The HDF5 library has no deflate filter.");
+    }
+  }
+
+  options.shuffle = p->SHUFFlagEncountered != 0;
+}
+
+/// @brief Convert the value of a /LATEST flag
+///
+/// 0 creates objects readable by HDF5 1.8, 1 uses the latest format for files
+/// which already need HDF5 1.10 and 2 always uses the latest format. Without
+/// the flag and IPNWB_Configure /LATEST the version bounds of the file are kept.
+LatestFormat ConvertLatestFormat(double value)
+{
+  switch(ConvertFromDouble<int>(value, "/LATEST must be 0, 1 or 2."))
+  {
+  case 0:
+    return LatestFormat::Never;
+  case 1:
+    return LatestFormat::IfCompatible;
+  case 2:
+    return LatestFormat::Always;
+  default:
+    throw IgorException(kParameterOutOfRange, "/LATEST must be 0, 1 or 2.");
+  }
+}
+
+/// @brief Read the file format requested with /LATEST into `options`
+template <typename T>
+void ReadLatestFormat(T p, CreationOptions &options)
+{
+  if(p->LATESTFlagEncountered)
+  {
+    options.latestFormat = ConvertLatestFormat(p->latestFormat);
+  }
+}
+
+/// @brief Return the dataset creation options requested with /CHUNK, /COMP, /SHUF, /WIDE, /LATEST and /GROW
+///
+/// /CHUNK=0 or no /CHUNK flag select the automatic chunk size. Options without flags are taken from `defaults`.
+CreationOptions ReadCreationOptions(IPNWB_WriteCompoundRuntimeParamsPtr p, const CreationOptions &defaults)
+{
+  CreationOptions options = defaults;
+
+  if(p->CHUNKFlagEncountered)
+  {
+    options.chunkSize = ConvertFromDouble<hsize_t>(p->chunkSize, "/CHUNK must be a non-negative integer.");
+
+    // HDF5 limits the size of a single chunk to 4GB
+    if(options.chunkSize > std::numeric_limits<uint32_t>::max() / COMPOUND_MAX_ROW_SIZE)
+    {
+      throw IgorException(kParameterOutOfRange, "/CHUNK is too large.");
+    }
+  }
+
+  ReadFilterOptions(p, options);
+  ReadLatestFormat(p, options);
+  options.wideIndices  = p->WIDEFlagEncountered != 0;
+  options.growCapacity = p->GROWFlagEncountered != 0;
+
+  return options;
+}
+
+/// @brief Return the first row and the number of rows selected with /RANGE={start, count}
+///
+/// A negative start counts from the end, the count is clamped to the available rows.
+std::pair<hsize_t, hsize_t> ReadRangeFlag(IPNWB_ReadCompoundRuntimeParamsPtr p, hsize_t numRows)
+{
+  if(!p->RANGEFlagEncountered)
+  {
+    return {0, numRows};
+  }
+
+  auto start = ConvertFromDouble<int64_t>(p->rangeStart, "/RANGE start must be an integer.");
+  auto count = ConvertFromDouble<hsize_t>(p->rangeCount, "/RANGE count must be a non-negative integer.");
+
+  if(start < 0)
+  {
+    start = std::max<int64_t>(0, static_cast<int64_t>(numRows) + start);
+  }
+  if(static_cast<hsize_t>(start) > numRows)
+  {
+    throw IgorException(kParameterOutOfRange, "/RANGE start is beyond the end of the dataset.");
+  }
+
+  const auto first = static_cast<hsize_t>(start);
+
+  return {first, std::min(count, numRows - first)};
+}
+
+/// @brief Return the data of a 1D wave which must be NT_I32 or NT_I64 as IntColumn
+IntColumn GetIntColumn(waveHndl w)
+{
+  return {WaveData(w), WaveType(w) == NT_I64};
+}
+
+/// @brief Return the data of a 1D wave which must be NT_I32 or NT_I64 as IntBuffer
+IntBuffer GetIntBuffer(waveHndl w)
+{
+  return {WaveData(w), WaveType(w) == NT_I64};
+}
+
+/// @brief Check that `w` is a 1D wave of the given type, or of `altType` if set, and return its number of rows
+size_t CheckInputWave(waveHndl w, int type, const std::string &name, int altType = -1)
+{
+  if(w == nullptr)
+  {
+    throw IgorException(ERR_INVALID_TYPE, "{} wave is null."_format(name));
+  }
+  if(WaveType(w) != type && WaveType(w) != altType)
+  {
+    throw IgorException(ERR_INVALID_TYPE, "{} wave has wrong type."_format(name));
+  }
+  auto dims = GetWaveDimension(w);
+  if(dims[1] > 0)
+  {
+    throw IgorException(ERR_INVALID_TYPE, "{} wave must be 1D."_format(name));
+  }
+
+  return To<size_t>(dims[0]);
+}
 
-struct dataPoint
+/// @brief Return the cumulative end indices of the ragged column described by `counts`
+///
+/// @param counts     number of elements per row, nullptr for one element per row
+/// @param numRows    number of rows
+/// @param firstIndex end index of the last existing row
+/// @param numValues  number of elements of the ragged column the indices must add up to
+std::vector<int64_t> GetRaggedIndices(const int *counts, size_t numRows, int64_t firstIndex, size_t numValues,
+                                      const std::string &name)
 {
-  int offset;
-  int size;
-  hobj_ref_t ref;
-};
+  std::vector<int64_t> indices(numRows);
+
+  int64_t index = firstIndex;
+  for(size_t i = 0; i < numRows; i++)
+  {
+    const int count = counts == nullptr ? 1 : counts[i];
+    if(count < 0)
+    {
+      throw IgorException(kParameterOutOfRange, "{} counts must not be negative."_format(name));
+    }
+    index += count;
+    indices[i] = index;
+  }
+
+  if(static_cast<uint64_t>(index - firstIndex) != numValues)
+  {
+    throw IgorException(ERR_INVALID_TYPE, "{} counts do not add up to the number of {} rows."_format(name, name));
+  }
+
+  return indices;
+}
 
 } // namespace
 
@@ -81,7 +264,7 @@ void Handler::IPNWB_WriteCompound(IPNWB_WriteCompoundRuntimeParamsPtr p)
   {
     throw IgorException(ERR_INVALID_TYPE, "Size wave is null.");
   }
-  if(WaveType(p->sizeWave) != NT_I32)
+  if(WaveType(p->sizeWave) != NT_I32 && WaveType(p->sizeWave) != NT_I64)
   {
     throw IgorException(ERR_INVALID_TYPE, "Size wave has wrong type.");
   }
@@ -94,7 +277,7 @@ void Handler::IPNWB_WriteCompound(IPNWB_WriteCompoundRuntimeParamsPtr p)
   {
     throw IgorException(ERR_INVALID_TYPE, "Offset wave is null.");
   }
-  if(WaveType(p->offsetWave) != NT_I32)
+  if(WaveType(p->offsetWave) != NT_I32 && WaveType(p->offsetWave) != NT_I64)
   {
     throw IgorException(ERR_INVALID_TYPE, "Offset wave has wrong type.");
   }
@@ -108,59 +291,120 @@ void Handler::IPNWB_WriteCompound(IPNWB_WriteCompoundRuntimeParamsPtr p)
     throw IgorException(ERR_INVALID_TYPE, "Waves must have the same size");
   }
 
-  try
-  {
-    hsize_t dims = sizeWaveDims[0];
-    H5::CompType compType(sizeof(dataPoint));
-    compType.insertMember(MEMBERNAME_START, 0, H5::PredType::STD_I32LE);
-    compType.insertMember(MEMBERNAME_COUNT, 4, H5::PredType::STD_I32LE);
-    compType.insertMember(MEMBERNAME_REF, 8, H5::PredType::STD_REF_OBJ);
+  const auto options = ReadCreationOptions(p, GetConfiguredOptions());
 
-    H5::H5File file(fileName, H5F_ACC_RDWR);
+  PhaseTimer timer(m_stats, Stats::Phase::WriteCompound);
+  timer.Add(To<size_t>(sizeWaveDims[0]), 0);
 
-    std::vector<dataPoint> compoundData(sizeWaveDims[0]);
+  if(p->ASYNCFlagEncountered)
+  {
+    if(p->BUFFERFlagEncountered)
+    {
+      throw IgorException(ERR_FLAGPARAMS, "/ASYNC can not be combined with /BUFFER.");
+    }
+
+    // only the write queue is touched here, the job locks the file when it runs
+    PhaseTimer marshalTimer(m_stats, Stats::Phase::WriteCompoundMarshal);
+    auto job         = std::make_shared<StagedRows>();
+    job->fileName    = fileName;
+    job->compPath    = compPath;
+    job->options     = options;
+    job->useRefCache = !p->NOCACHEFlagEncountered;
 
-    std::vector<IndexInt> dimCnt(MAX_DIMENSIONS, 0);
-    for(auto &dp : compoundData)
+    const auto numRows = To<size_t>(sizeWaveDims[0]);
+    const auto offsets = GetIntColumn(p->offsetWave);
+    const auto sizes   = GetIntColumn(p->sizeWave);
+    job->offsets.resize(numRows);
+    job->sizes.resize(numRows);
+    for(size_t i = 0; i < numRows; i++)
     {
-      dp.offset = GetWaveElement<int>(p->offsetWave, dimCnt);
-      dp.size   = GetWaveElement<int>(p->sizeWave, dimCnt);
-      file.reference(&dp.ref, GetWaveElement<std::string>(p->tsRefWave, dimCnt));
-      dimCnt[0]++;
+      job->offsets[i] = offsets[i];
+      job->sizes[i]   = sizes[i];
     }
 
-    if(file.exists(compPath))
+    TextWaveView tsRefs(p->tsRefWave);
+    job->refs.reserve(numRows);
+    for(size_t i = 0; i < numRows; i++)
     {
-      H5::DataSet dataSet = file.openDataSet(compPath);
-      if(dataSet.getCreatePlist().getLayout() != H5D_CHUNKED)
+      job->refs.emplace_back(tsRefs[i]);
+    }
+    marshalTimer.Add(numRows, 0);
+
+    const auto numPending = m_asyncWriter.Enqueue(fileName, [this, job] {
+      CompoundRows rows;
+      rows.numRows = job->offsets.size();
+      rows.offsets = {job->offsets.data(), true};
+      rows.sizes   = {job->sizes.data(), true};
+      rows.refs.assign(job->refs.begin(), job->refs.end());
+
+      try
+      {
+        auto fileLock = m_fileLocks.Lock(job->fileName);
+        auto hdf5Lock = LockHDF5();
+
+        FlushStagedRows(job->fileName, job->compPath);
+        AppendRows(job->fileName, job->compPath, job->options, rows, job->useRefCache);
+      }
+      catch(std::exception const &ex)
+      {
+        throw IgorException(ERR_HDF5, "{} {}: {}"_format(job->fileName, job->compPath, ex.what()));
+      }
+      catch(H5::Exception const &ex)
       {
-        throw IgorException(ERR_HDF5, "Existing dataset is not "
-                                      "chunked. Can not append new data.");
+        throw IgorException(ERR_HDF5, "{} {}: {}"_format(job->fileName, job->compPath, ex.getCDetailMsg()));
       }
+    });
+
+    SetOperationReturn("V_refCacheHits", 0);
+    SetOperationReturn("V_refCacheMisses", 0);
+    SetOperationReturn("V_pendingRows", 0);
+    SetOperationReturn("V_pendingWrites", static_cast<double>(numPending));
+    return;
+  }
+
+  // keep the order of earlier asynchronous writes, the jobs lock the file themselves
+  m_asyncWriter.RunPending(fileName);
+
+  auto fileLock = m_fileLocks.Lock(fileName);
 
-      hsize_t oldSize = dataSet.getSpace().getSelectNpoints();
-      hsize_t newSize = oldSize + dims;
-      dataSet.extend(&newSize);
+  // rows.refs point into the text wave view, which must outlive them
+  TextWaveView tsRefs(p->tsRefWave);
+  CompoundRows rows;
+  {
+    PhaseTimer marshalTimer(m_stats, Stats::Phase::WriteCompoundMarshal);
 
-      H5::DataSpace extFileDataSpace = dataSet.getSpace();
-      extFileDataSpace.selectHyperslab(H5S_SELECT_SET, &dims, &oldSize);
-      H5::DataSpace memDataSpace(1, &dims, nullptr);
+    rows.numRows = To<size_t>(sizeWaveDims[0]);
+    rows.offsets = GetIntColumn(p->offsetWave);
+    rows.sizes   = GetIntColumn(p->sizeWave);
+    rows.refs.reserve(rows.numRows);
+    for(size_t i = 0; i < rows.numRows; i++)
+    {
+      rows.refs.push_back(tsRefs[i]);
+    }
+    marshalTimer.Add(rows.numRows, 0);
+  }
 
-      dataSet.write(compoundData.data(), compType, memDataSpace, extFileDataSpace);
+  try
+  {
+    AppendResult result;
+    size_t pendingRows = 0;
+    if(p->BUFFERFlagEncountered)
+    {
+      pendingRows = StageRows(fileName, compPath, options, !p->NOCACHEFlagEncountered, rows);
     }
     else
     {
-      hsize_t maxDims = H5S_UNLIMITED;
-      H5::DataSpace dataSpace(1, &dims, &maxDims);
-
-      H5::DSetCreatPropList dsetPropList;
-      hsize_t chunkSize = 1;
-      // note: layout is set to H5D_CHUNKED automatically.
-      dsetPropList.setChunk(1, &chunkSize);
-      H5::DataSet dataSet = file.createDataSet(compPath, compType, dataSpace, dsetPropList);
+      auto hdf5Lock = LockHDF5();
 
-      dataSet.write(compoundData.data(), compType);
+      // keep the row order of previously buffered rows
+      FlushStagedRows(fileName, compPath);
+      result = AppendRows(fileName, compPath, options, rows, !p->NOCACHEFlagEncountered);
     }
+
+    SetOperationReturn("V_refCacheHits", static_cast<double>(result.refCacheHits));
+    SetOperationReturn("V_refCacheMisses", static_cast<double>(result.refCacheMisses));
+    SetOperationReturn("V_pendingRows", static_cast<double>(pendingRows));
+    SetOperationReturn("V_pendingWrites", 0);
   }
   catch(H5::Exception const &ex)
   {
@@ -168,141 +412,1297 @@ void Handler::IPNWB_WriteCompound(IPNWB_WriteCompoundRuntimeParamsPtr p)
   }
 }
 
-void Handler::IPNWB_ReadCompound(IPNWB_ReadCompoundRuntimeParamsPtr p)
+AppendResult Handler::AppendRows(const std::string &fileName, const std::string &compPath,
+                                 const CreationOptions &options, const CompoundRows &rows, bool useRefCache)
 {
-
-  if(!p->SFlagEncountered || !p->CFlagEncountered || !p->REFFlagEncountered || !p->LOCFlagEncountered ||
-     !p->fullFileNameEncountered)
+  std::shared_ptr<H5::H5File> filePtr;
   {
-    throw IgorException(ERR_FLAGPARAMS, "Parameter(s) missing.");
+    PhaseTimer timer(m_stats, Stats::Phase::WriteCompoundOpen);
+    filePtr = OpenFile(fileName, FilePool::Mode::ReadWrite);
   }
-  auto fileName = GetStringFromHandle(p->fullFileName);
-  if(fileName.empty())
+
+  return CompoundEngine::AppendRows(*filePtr, compPath, options, rows, useRefCache, m_stats);
+}
+
+size_t Handler::StageRows(const std::string &fileName, const std::string &compPath, const CreationOptions &options,
+                          bool useRefCache, const CompoundRows &rows)
+{
+  const auto key = std::make_pair(GetCanonicalPath(fileName), compPath);
+
+  bool otherOptions = false;
   {
-    throw IgorException(ERR_INVALID_TYPE, "File name missing.");
+    StateLock lock(m_stateMutex);
+
+    auto it      = m_stagedRows.find(key);
+    otherOptions = it != m_stagedRows.end() && (it->second.options != options || it->second.useRefCache != useRefCache);
   }
-  auto compPath = GetStringFromHandle(p->compPath);
-  if(compPath.empty())
+
+  // a buffer has one set of options, rows buffered with other ones are written with theirs
+  if(otherOptions)
   {
-    throw IgorException(ERR_INVALID_TYPE, "HDF5 data path missing.");
+    auto hdf5Lock = LockHDF5();
+    FlushStagedRows(fileName, compPath);
   }
 
-  auto niceRefs = std::vector<std::string>();
-  auto offsets  = std::vector<int>();
-  auto sizes    = std::vector<int>();
-  hssize_t numPoints;
-  size_t numDataPoints = 0;
+  const bool needs64Bit = Needs64Bit(rows.offsets, rows.numRows) || Needs64Bit(rows.sizes, rows.numRows);
+  auto checkFit         = [&compPath, needs64Bit](bool allows64Bit) {
+    if(needs64Bit && !allows64Bit)
+    {
+      throw CompoundError(CompoundError::Kind::OutOfRange,
+                          "Existing dataset {} has 32bit members, the offsets or sizes do not fit."_format(compPath));
+    }
+  };
 
-  try
+  // check the rows like AppendRows() does, so that they fail their own call and not the later write
+  bool newBuffer = false;
+  std::set<std::string, std::less<>> newRefs;
   {
-    H5::H5File file(fileName, H5F_ACC_RDONLY);
-    if(!file.exists(compPath))
+    StateLock lock(m_stateMutex);
+
+    auto it   = m_stagedRows.find(key);
+    newBuffer = it == m_stagedRows.end();
+    if(!newBuffer)
     {
-      throw IgorException(ERR_INVALID_TYPE, "HDF5 data not present at given path.");
+      checkFit(it->second.allows64Bit);
     }
-    H5::DataSet dataSet = file.openDataSet(compPath);
 
-    H5::DataType dataType = dataSet.getDataType();
-    H5::CompType compType(sizeof(dataPoint));
-    if(!dataType.detectClass(compType.getClass()))
+    for(const auto &ref : rows.refs)
     {
-      throw IgorException(ERR_INVALID_TYPE, "Referenced HDF5 dataset has not compound type.");
+      if(it == m_stagedRows.end() || it->second.checkedRefs.count(ref) == 0)
+      {
+        newRefs.emplace(ref);
+      }
     }
-    compType = H5::CompType(dataSet);
-    if(compType.getNmembers() != MEMBERNUMBER)
+  }
+
+  bool allows64Bit = true;
+  if(newBuffer || !newRefs.empty())
+  {
+    auto hdf5Lock = LockHDF5();
+    auto filePtr  = OpenFile(fileName, FilePool::Mode::ReadWrite);
+
+    // the schema of the dataset is only checked once per buffer, all writes to it write the buffer first
+    if(newBuffer && filePtr->exists(compPath))
     {
-      throw IgorException(ERR_INVALID_TYPE, "Referenced HDF5 compound has not {} members."_format(MEMBERNUMBER));
+      GetAppendableSize(*filePtr, compPath);
+      allows64Bit = CheckCompoundSchema(filePtr->openDataSet(compPath));
+      checkFit(allows64Bit);
     }
 
-    auto CheckCompoundMemberType = [](const H5::CompType &compType, const int index, const H5::PredType &predType) {
-      if(!(compType.getMemberDataType(index) == predType))
+    ReferenceCache refCache(*filePtr);
+    for(const auto &ref : newRefs)
+    {
+      try
       {
-        throw IgorException(ERR_INVALID_TYPE, "Referenced HDF5 compound member has wrong type.");
+        refCache.Get(ref);
       }
-    };
+      catch(H5::Exception const &ex)
+      {
+        throw IgorException(ERR_INVALID_TYPE, "Invalid reference {}: {}"_format(ref, ex.getCDetailMsg()));
+      }
+    }
+  }
+
+  StagedRows full;
+  {
+    StateLock lock(m_stateMutex);
 
-    int memIndexStart = compType.getMemberIndex(MEMBERNAME_START);
-    CheckCompoundMemberType(compType, memIndexStart, H5::PredType::STD_I32LE);
-    int memIndexCount = compType.getMemberIndex(MEMBERNAME_COUNT);
-    CheckCompoundMemberType(compType, memIndexCount, H5::PredType::STD_I32LE);
-    int memIndexRef = compType.getMemberIndex(MEMBERNAME_REF);
-    CheckCompoundMemberType(compType, memIndexRef, H5::PredType::STD_REF_OBJ);
-    if((memIndexStart != MEMBERNAME_START_IDX) || (memIndexCount != MEMBERNAME_COUNT_IDX) ||
-       (memIndexRef != MEMBERNAME_REF_IDX))
+    auto it = m_stagedRows.find(key);
+    if(it == m_stagedRows.end())
     {
-      throw IgorException(ERR_INVALID_TYPE, "Referenced HDF5 compound member has wrong element order.");
+      it                     = m_stagedRows.emplace(key, StagedRows()).first;
+      it->second.fileName    = fileName;
+      it->second.compPath    = compPath;
+      it->second.options     = options;
+      it->second.useRefCache = useRefCache;
+      it->second.allows64Bit = allows64Bit;
     }
 
-    numPoints = dataSet.getSpace().getSelectNpoints();
-    if(numPoints > 0)
+    auto &staged = it->second;
+    for(size_t i = 0; i < rows.numRows; i++)
     {
-      numDataPoints = static_cast<size_t>(numPoints);
+      staged.offsets.push_back(rows.offsets[i]);
+      staged.sizes.push_back(rows.sizes[i]);
+      staged.refs.emplace_back(rows.refs[i]);
+      staged.numBytes += sizeof(int64_t) * 2 + rows.refs[i].size();
     }
-    std::vector<dataPoint> compoundData(numDataPoints);
-    dataSet.read(compoundData.data(), compType);
+    staged.checkedRefs.merge(newRefs);
 
-    for(const auto &dp : compoundData)
+    if(staged.offsets.size() < m_bufferMaxRows && staged.numBytes < m_bufferMaxBytes)
     {
-      // dereferencing changes dset internally to a H5::Object, which is opened and requires a separate close
-      auto dset = std::make_shared<H5::DataSet>(file, &dp.ref);
-      niceRefs.push_back(dset->getObjName());
-      offsets.push_back(dp.offset);
-      sizes.push_back(dp.size);
-      H5Oclose(dset->getId());
+      return staged.offsets.size();
     }
+
+    full = std::move(staged);
+    m_stagedRows.erase(it);
+  }
+
+  auto hdf5Lock = LockHDF5();
+  WriteStagedRows(std::move(full));
+
+  return 0;
+}
+
+void Handler::WriteStagedRows(StagedRows &&staged)
+{
+  CompoundRows rows;
+  rows.numRows = staged.offsets.size();
+  rows.offsets = {staged.offsets.data(), true};
+  rows.sizes   = {staged.sizes.data(), true};
+  rows.refs.assign(staged.refs.begin(), staged.refs.end());
+
+  // the rows were checked when they were buffered, rows failing nonetheless are dropped and reported once
+  try
+  {
+    AppendRows(staged.fileName, staged.compPath, staged.options, rows, staged.useRefCache);
   }
   catch(H5::Exception const &ex)
   {
-    throw IgorException(ERR_HDF5, ex.getCDetailMsg());
+    m_asyncWriter.AddError("{} {}: {}"_format(staged.fileName, staged.compPath, ex.getCDetailMsg()));
   }
+  catch(std::exception const &ex)
+  {
+    m_asyncWriter.AddError("{} {}: {}"_format(staged.fileName, staged.compPath, ex.what()));
+  }
+}
 
-  auto dimCnt = std::vector<CountInt>(MAX_DIMENSIONS + 1, 0);
-  dimCnt[0]   = numDataPoints;
+void Handler::FlushStagedRows(const std::string &fileName, const std::string &compPath)
+{
+  StagedRows staged;
+  {
+    StateLock lock(m_stateMutex);
+
+    if(m_stagedRows.empty())
+    {
+      return;
+    }
+
+    auto it = m_stagedRows.find(std::make_pair(GetCanonicalPath(fileName), compPath));
+    if(it == m_stagedRows.end())
+    {
+      return;
+    }
+
+    staged = std::move(it->second);
+    m_stagedRows.erase(it);
+  }
+
+  WriteStagedRows(std::move(staged));
+}
+
+void Handler::FlushStagedRows(const std::string &fileName)
+{
+  std::vector<StagedRows> stagedRows;
   {
-    auto checkWaveProperties = [](waveHndl w) {
-      if(WaveType(w) != TEXT_WAVE_TYPE)
+    StateLock lock(m_stateMutex);
+
+    if(m_stagedRows.empty())
+    {
+      return;
+    }
+
+    const auto key = GetCanonicalPath(fileName);
+    for(auto it = m_stagedRows.begin(); it != m_stagedRows.end();)
+    {
+      if(it->first.first == key)
       {
-        throw IgorException(ERR_INVALID_TYPE, "Only text waves are supported with /REF.");
+        stagedRows.push_back(std::move(it->second));
+        it = m_stagedRows.erase(it);
       }
-    };
+      else
+      {
+        ++it;
+      }
+    }
+  }
 
-    auto typeGetter = [](waveHndl /*unused*/) { return TEXT_WAVE_TYPE; };
+  for(auto &staged : stagedRows)
+  {
+    WriteStagedRows(std::move(staged));
+  }
+}
 
-    auto setWaveContents = [&](waveHndl w) { StringVectorToTextWave(niceRefs, w); };
+void Handler::FlushAllStagedRows()
+{
+  std::set<std::string> fileNames;
+  {
+    StateLock lock(m_stateMutex);
 
-    HandleDestWave(p->REFFlagParamsSet[0], p->tsRefWave, p->FREEFlagEncountered, dimCnt, checkWaveProperties,
-                   typeGetter, setWaveContents);
+    for(const auto &elem : m_stagedRows)
+    {
+      fileNames.insert(elem.first.first);
+    }
   }
+
+  std::exception_ptr firstError;
+  for(const auto &fileName : fileNames)
   {
-    auto checkWaveProperties = [](waveHndl w) {
-      if(WaveType(w) != NT_I32)
+    try
+    {
+      auto fileLock = m_fileLocks.Lock(fileName);
+      auto hdf5Lock = LockHDF5();
+      FlushStagedRows(fileName);
+    }
+    catch(...)
+    {
+      if(!firstError)
       {
-        throw IgorException(ERR_INVALID_TYPE, "Only integer waves are supported with /S.");
+        firstError = std::current_exception();
       }
-    };
+    }
+  }
+
+  if(firstError)
+  {
+    std::rethrow_exception(firstError);
+  }
+}
+
+void Handler::IPNWB_ReadCompound(IPNWB_ReadCompoundRuntimeParamsPtr p)
+{
+
+  if(!p->SFlagEncountered || !p->CFlagEncountered || !p->REFFlagEncountered || !p->LOCFlagEncountered)
+  {
+    throw IgorException(ERR_FLAGPARAMS, "Parameter(s) missing.");
+  }
+  const bool fromImage = p->IMGFlagEncountered != 0;
+  if(fromImage == (p->fullFileNameEncountered != 0))
+  {
+    throw IgorException(ERR_FLAGPARAMS, "Either /IMG or a file name is required.");
+  }
+  const auto fileName = fromImage ? std::string() : GetStringFromHandle(p->fullFileName);
+  if(!fromImage && fileName.empty())
+  {
+    throw IgorException(ERR_INVALID_TYPE, "File name missing.");
+  }
+  if(fromImage)
+  {
+    if(CheckInputWave(p->imageWave, NT_I8 | NT_UNSIGNED, "Image", NT_I8) == 0)
+    {
+      throw IgorException(ERR_INVALID_TYPE, "Image wave is empty.");
+    }
+    if(p->CACHEFlagEncountered)
+    {
+      throw IgorException(ERR_FLAGPARAMS, "/CACHE is not supported with /IMG.");
+    }
+  }
+  auto compPath = GetStringFromHandle(p->compPath);
+  if(compPath.empty())
+  {
+    throw IgorException(ERR_INVALID_TYPE, "HDF5 data path missing.");
+  }
 
-    auto typeGetter = [](waveHndl /*unused*/) { return NT_I32; };
+  PhaseTimer timer(m_stats, Stats::Phase::ReadCompound);
 
-    auto setWaveContents = [&](waveHndl w) { std::memcpy(WaveData(w), offsets.data(), offsets.size() * sizeof(int)); };
+  // a file image is private to this call, it is neither written to nor locked
+  std::optional<FileLocks::Guard> fileLock;
+  if(!fromImage)
+  {
+    // rows written with IPNWB_WriteCompound /ASYNC must be visible, the jobs lock the file themselves
+    m_asyncWriter.RunPending(fileName);
 
-    HandleDestWave(p->SFlagParamsSet[0], p->offsetWave, p->FREEFlagEncountered, dimCnt, checkWaveProperties, typeGetter,
-                   setWaveContents);
+    fileLock.emplace(m_fileLocks.Lock(fileName));
   }
+
+  // the image is opened again for reading the members, its wave is not used while the result waves are created
+  auto openFile = [&]() -> std::shared_ptr<H5::H5File> {
+    if(fromImage)
+    {
+      return std::make_shared<H5::H5File>(OpenFileImage(WaveData(p->imageWave), WavePoints(p->imageWave)));
+    }
+
+    return OpenFile(fileName, FilePool::Mode::ReadOnly);
+  };
+
+  try
   {
-    auto checkWaveProperties = [](waveHndl w) {
-      if(WaveType(w) != NT_I32)
+    bool is64Bit  = false;
+    hsize_t first = 0;
+    hsize_t count = 0;
+    ResolvedReferences resolved;
+
+    {
+      auto hdf5Lock = LockHDF5();
+
+      // rows written with IPNWB_WriteCompound /BUFFER must be visible
+      if(!fromImage)
       {
-        throw IgorException(ERR_INVALID_TYPE, "Only integer waves are supported with /C.");
+        FlushStagedRows(fileName, compPath);
       }
-    };
 
-    auto typeGetter = [](waveHndl /*unused*/) { return NT_I32; };
+      PhaseTimer openTimer(m_stats, Stats::Phase::ReadCompoundOpen);
+      auto filePtr        = openFile();
+      auto &file          = *filePtr;
+      H5::DataSet dataSet = OpenCompound(file, compPath, is64Bit);
 
-    auto setWaveContents = [&](waveHndl w) { std::memcpy(WaveData(w), sizes.data(), sizes.size() * sizeof(int)); };
+      std::tie(first, count) = ReadRangeFlag(p, GetNumRows(dataSet));
+      timer.Add(count, 0);
+      openTimer.Stop();
 
-    HandleDestWave(p->CFlagParamsSet[0], p->sizeWave, p->FREEFlagEncountered, dimCnt, checkWaveProperties, typeGetter,
-                   setWaveContents);
-  }
+      std::vector<hobj_ref_t> refs;
+      {
+        PhaseTimer readTimer(m_stats, Stats::Phase::ReadCompoundRead);
+        refs = ReadReferences(dataSet, first, count);
+        readTimer.Add(count, count * sizeof(hobj_ref_t));
+      }
+
+      PhaseTimer dereferenceTimer(m_stats, Stats::Phase::ReadCompoundDereference);
+      std::shared_ptr<DereferenceCache> refCache;
+      if(p->CACHEFlagEncountered)
+      {
+        refCache = GetPersistentDereferenceCache(fileName);
+      }
+      if(!refCache)
+      {
+        refCache = std::make_shared<DereferenceCache>();
+      }
+      const auto hitsBefore   = refCache->GetHits();
+      const auto missesBefore = refCache->GetMisses();
+
+      // with /REFI one path per distinct reference and the index of it for every row
+      resolved = ResolveReferences(file, refs, *refCache, p->REFIFlagEncountered != 0);
+
+      dereferenceTimer.Add(count, 0);
+
+      SetOperationReturn("V_refCacheHits", static_cast<double>(refCache->GetHits() - hitsBefore));
+      SetOperationReturn("V_refCacheMisses", static_cast<double>(refCache->GetMisses() - missesBefore));
+    }
+
+    // the waves are created and the text wave is filled without holding the HDF5 lock
+    PhaseTimer wavesTimer(m_stats, Stats::Phase::ReadCompoundWaves);
+    auto dimCnt = std::vector<CountInt>(MAX_DIMENSIONS + 1, 0);
+    dimCnt[0]   = static_cast<CountInt>(count);
+    {
+      auto checkWaveProperties = [](waveHndl w) {
+        if(WaveType(w) != TEXT_WAVE_TYPE)
+        {
+          throw IgorException(ERR_INVALID_TYPE, "Only text waves are supported with /REF.");
+        }
+      };
+
+      auto typeGetter = [](waveHndl /*unused*/) { return TEXT_WAVE_TYPE; };
+
+      auto setWaveContents = [&](waveHndl w) { StringVectorToTextWave(resolved.paths, w); };
+
+      auto refDimCnt = dimCnt;
+      refDimCnt[0]   = static_cast<CountInt>(resolved.paths.size());
+
+      HandleDestWave(p->REFFlagParamsSet[0], p->tsRefWave, p->FREEFlagEncountered, refDimCnt, checkWaveProperties,
+                     typeGetter, setWaveContents);
+    }
+    if(p->REFIFlagEncountered)
+    {
+      auto checkWaveProperties = [](waveHndl w) {
+        if(WaveType(w) != NT_I32)
+        {
+          throw IgorException(ERR_INVALID_TYPE, "Only 32bit integer waves are supported with /REFI.");
+        }
+      };
+
+      auto typeGetter = [](waveHndl /*unused*/) { return NT_I32; };
+
+      auto setWaveContents = [&](waveHndl w) {
+        std::memcpy(WaveData(w), resolved.indices.data(), resolved.indices.size() * sizeof(int32_t));
+      };
+
+      HandleDestWave(p->REFIFlagParamsSet[0], p->refIndexWave, p->FREEFlagEncountered, dimCnt, checkWaveProperties,
+                     typeGetter, setWaveContents);
+    }
+
+    // filled below, straight from the file
+    waveHndl offsetWave = nullptr;
+    waveHndl sizeWave   = nullptr;
+    {
+      auto checkWaveProperties = [](waveHndl w) {
+        if(WaveType(w) != NT_I32 && WaveType(w) != NT_I64)
+        {
+          throw IgorException(ERR_INVALID_TYPE, "Only integer waves are supported with /S.");
+        }
+      };
+
+      // 64bit waves only for the 64bit schema, keeps existing code working with 32bit waves
+      auto typeGetter = [&](waveHndl /*unused*/) { return is64Bit ? NT_I64 : NT_I32; };
+
+      auto setWaveContents = [&](waveHndl w) { offsetWave = w; };
+
+      HandleDestWave(p->SFlagParamsSet[0], p->offsetWave, p->FREEFlagEncountered, dimCnt, checkWaveProperties,
+                     typeGetter, setWaveContents);
+    }
+    {
+      auto checkWaveProperties = [](waveHndl w) {
+        if(WaveType(w) != NT_I32 && WaveType(w) != NT_I64)
+        {
+          throw IgorException(ERR_INVALID_TYPE, "Only integer waves are supported with /C.");
+        }
+      };
+
+      // 64bit waves only for the 64bit schema, keeps existing code working with 32bit waves
+      auto typeGetter = [&](waveHndl /*unused*/) { return is64Bit ? NT_I64 : NT_I32; };
+
+      auto setWaveContents = [&](waveHndl w) { sizeWave = w; };
+
+      HandleDestWave(p->CFlagParamsSet[0], p->sizeWave, p->FREEFlagEncountered, dimCnt, checkWaveProperties,
+                     typeGetter, setWaveContents);
+    }
+    wavesTimer.Add(count, 0);
+    wavesTimer.Stop();
+
+    if(count > 0)
+    {
+      auto hdf5Lock = LockHDF5();
+      PhaseTimer readTimer(m_stats, Stats::Phase::ReadCompoundRead);
+
+      // we still hold the file lock, so the dataset is unchanged, file images are read-only
+      auto filePtr        = openFile();
+      H5::DataSet dataSet = filePtr->openDataSet(compPath);
+
+      // HDF5 converts the members to the type of the wave
+      ReadIntMember(dataSet, GetIntBuffer(offsetWave), MEMBERNAME_START, first, count);
+      ReadIntMember(dataSet, GetIntBuffer(sizeWave), MEMBERNAME_COUNT, first, count);
+      readTimer.Add(0, count * (GetWaveElementSize(WaveType(offsetWave)) + GetWaveElementSize(WaveType(sizeWave))));
+    }
+    WaveHandleModified(offsetWave);
+    WaveHandleModified(sizeWave);
+  }
+  catch(H5::Exception const &ex)
+  {
+    throw IgorException(ERR_HDF5, ex.getCDetailMsg());
+  }
+}
+
+void Handler::IPNWB_CompoundInfo(IPNWB_CompoundInfoRuntimeParamsPtr p)
+{
+  if(!p->LOCFlagEncountered || !p->fullFileNameEncountered)
+  {
+    throw IgorException(ERR_FLAGPARAMS, "Parameter(s) missing.");
+  }
+  auto fileName = GetStringFromHandle(p->fullFileName);
+  if(fileName.empty())
+  {
+    throw IgorException(ERR_INVALID_TYPE, "File name missing.");
+  }
+  auto compPath = GetStringFromHandle(p->compPath);
+  if(compPath.empty())
+  {
+    throw IgorException(ERR_INVALID_TYPE, "HDF5 data path missing.");
+  }
+
+  // rows written with IPNWB_WriteCompound /ASYNC must be counted, the jobs lock the file themselves
+  m_asyncWriter.RunPending(fileName);
+
+  auto fileLock = m_fileLocks.Lock(fileName);
+
+  try
+  {
+    CompoundInfo info;
+    unsigned int superblock = 0;
+
+    {
+      auto hdf5Lock = LockHDF5();
+
+      // rows written with IPNWB_WriteCompound /BUFFER must be counted
+      FlushStagedRows(fileName, compPath);
+
+      auto filePtr = OpenFile(fileName, FilePool::Mode::ReadOnly);
+      bool is64Bit = false;
+      info         = GetCompoundInfo(OpenCompound(*filePtr, compPath, is64Bit));
+      superblock   = GetSuperblockVersion(*filePtr);
+    }
+
+    SetOperationReturn("V_numRows", static_cast<double>(info.numRows));
+    SetOperationReturn("V_capacity", static_cast<double>(info.capacity));
+    SetOperationReturn("V_rowSize", static_cast<double>(info.rowSize));
+    SetOperationReturn("V_wide", info.is64Bit ? 1.0 : 0.0);
+    SetOperationReturn("V_storageSize", static_cast<double>(info.storageSize));
+    SetOperationReturn("V_chunkSize", static_cast<double>(info.chunkSize));
+    SetOperationReturn("V_compLevel", static_cast<double>(info.deflateLevel));
+    SetOperationReturn("V_shuffle", info.shuffle ? 1.0 : 0.0);
+    SetOperationReturn("V_superblock", static_cast<double>(superblock));
+    SetOperationReturn("S_filters", info.filters);
+    SetOperationReturn("S_chunkIndex", info.chunkIndex);
+
+    if(p->MEMFlagEncountered)
+    {
+      // one row per member, columns are name, byte offset, byte size and type
+      const std::vector<std::string> columns = {"name", "offset", "size", "type"};
+      const size_t numMembers                = info.members.size();
+
+      std::vector<std::string> layout(numMembers * columns.size());
+      for(size_t i = 0; i < numMembers; i++)
+      {
+        const auto &member         = info.members[i];
+        layout[i]                  = member.name;
+        layout[i + numMembers]     = std::to_string(member.offset);
+        layout[i + 2 * numMembers] = std::to_string(member.size);
+        layout[i + 3 * numMembers] = member.type;
+      }
+
+      auto dimCnt = std::vector<CountInt>(MAX_DIMENSIONS + 1, 0);
+      dimCnt[0]   = static_cast<CountInt>(numMembers);
+      dimCnt[1]   = static_cast<CountInt>(columns.size());
+
+      auto checkWaveProperties = [](waveHndl w) {
+        if(WaveType(w) != TEXT_WAVE_TYPE)
+        {
+          throw IgorException(ERR_INVALID_TYPE, "Only text waves are supported with /MEM.");
+        }
+      };
+
+      auto typeGetter = [](waveHndl /*unused*/) { return TEXT_WAVE_TYPE; };
+
+      auto setWaveContents = [&](waveHndl w) {
+        StringVectorToTextWave(layout, w);
+        SetDimensionLabels(w, COLUMNS, columns);
+      };
+
+      HandleDestWave(p->MEMFlagParamsSet[0], p->memberWave, p->FREEFlagEncountered, dimCnt, checkWaveProperties,
+                     typeGetter, setWaveContents);
+    }
+  }
+  catch(H5::Exception const &ex)
+  {
+    throw IgorException(ERR_HDF5, ex.getCDetailMsg());
+  }
+}
+
+CreationOptions Handler::GetConfiguredOptions()
+{
+  StateLock lock(m_stateMutex);
+
+  CreationOptions options;
+  options.latestFormat = m_latestFormat;
+  options.numThreads   = m_numThreads;
+  options.directChunks = m_directChunks;
+
+  return options;
+}
+
+std::shared_ptr<DereferenceCache> Handler::GetPersistentDereferenceCache(const std::string &fileName)
+{
+  // different spellings of the path share the cache
+  const auto key = GetCanonicalPath(fileName);
+
+  FileStamp stamp;
+  const bool hasStamp = GetFileStamp(fileName, stamp);
+
+  StateLock lock(m_stateMutex);
+
+  if(!hasStamp)
+  {
+    m_dereferenceCaches.erase(key);
+    return nullptr;
+  }
+
+  auto &entry = m_dereferenceCaches[key];
+  if(!entry.cache || entry.stamp != stamp)
+  {
+    entry.cache = std::make_shared<DereferenceCache>();
+    entry.stamp = stamp;
+  }
+  entry.lastUsed = ++m_dereferenceCacheUseCount;
+
+  // the cache stays valid for the caller even if it is evicted
+  auto cache = entry.cache;
+
+  if(m_dereferenceCaches.size() > MAX_PERSISTENT_DEREFERENCE_CACHES)
+  {
+    auto lru = std::min_element(m_dereferenceCaches.begin(), m_dereferenceCaches.end(),
+                                [](const auto &a, const auto &b) { return a.second.lastUsed < b.second.lastUsed; });
+    m_dereferenceCaches.erase(lru);
+  }
+
+  return cache;
+}
+
+void Handler::IPNWB_CloseFile(IPNWB_CloseFileRuntimeParamsPtr p)
+{
+  if(p->AFlagEncountered == p->fullFileNameEncountered)
+  {
+    throw IgorException(ERR_FLAGPARAMS, "Either /A or a file name is required.");
+  }
+
+  try
+  {
+    if(p->AFlagEncountered)
+    {
+      CloseAllFiles();
+      return;
+    }
+
+    auto fileName = GetStringFromHandle(p->fullFileName);
+    if(fileName.empty())
+    {
+      throw IgorException(ERR_INVALID_TYPE, "File name missing.");
+    }
+
+    m_asyncWriter.RunPending(fileName);
+
+    auto fileLock = m_fileLocks.Lock(fileName);
+    auto hdf5Lock = LockHDF5();
+
+    auto closeFile = [&] {
+      {
+        StateLock lock(m_stateMutex);
+        m_filePool.Close(fileName);
+      }
+      CloseRemovedFiles();
+    };
+
+    try
+    {
+      FlushStagedRows(fileName);
+    }
+    catch(...)
+    {
+      closeFile();
+      throw;
+    }
+
+    closeFile();
+  }
+  catch(H5::Exception const &ex)
+  {
+    throw IgorException(ERR_HDF5, ex.getCDetailMsg());
+  }
+}
+
+void Handler::IPNWB_FlushAll(IPNWB_FlushAllRuntimeParamsPtr /*p*/)
+{
+  try
+  {
+    m_asyncWriter.RunPending();
+    FlushAllStagedRows();
+
+    std::vector<std::string> fileNames;
+    {
+      StateLock lock(m_stateMutex);
+      fileNames = m_filePool.GetFileNames();
+    }
+
+    // flushing a file must not interfere with a running write to it
+    for(const auto &fileName : fileNames)
+    {
+      auto fileLock = m_fileLocks.Lock(fileName);
+      auto hdf5Lock = LockHDF5();
+
+      std::shared_ptr<H5::H5File> filePtr;
+      {
+        StateLock lock(m_stateMutex);
+        filePtr = m_filePool.GetWritable(fileName);
+      }
+
+      if(filePtr)
+      {
+        filePtr->flush(H5F_SCOPE_GLOBAL);
+      }
+    }
+  }
+  catch(H5::Exception const &ex)
+  {
+    throw IgorException(ERR_HDF5, ex.getCDetailMsg());
+  }
+}
+
+void Handler::IPNWB_Configure(IPNWB_ConfigureRuntimeParamsPtr p)
+{
+  if(p->IDLEFlagEncountered && !(p->idleTimeout >= 0))
+  {
+    throw IgorException(kParameterOutOfRange, "/IDLE must be a non-negative number of seconds.");
+  }
+
+  const auto idleTimeout =
+      p->IDLEFlagEncountered
+          ? ConvertFromDouble<int64_t>(p->idleTimeout * 1000, "/IDLE must be a non-negative number of seconds.")
+          : 0;
+  const auto bufferRows =
+      p->BUFROWSFlagEncountered ? ConvertFromDouble<size_t>(p->bufferRows, "/BUFROWS must be a non-negative integer.")
+                                : 0;
+  const auto bufferBytes =
+      p->BUFBYTESFlagEncountered
+          ? ConvertFromDouble<size_t>(p->bufferBytes, "/BUFBYTES must be a non-negative integer.")
+          : 0;
+  const auto poolSize =
+      p->POOLFlagEncountered ? ConvertFromDouble<size_t>(p->poolSize, "/POOL must be a non-negative integer.") : 0;
+  const auto latestFormat = p->LATESTFlagEncountered ? ConvertLatestFormat(p->latestFormat) : LatestFormat::Never;
+  const auto numThreads =
+      p->THREADSFlagEncountered
+          ? ConvertFromDouble<unsigned int>(p->numThreads, "/THREADS must be an integer between 0 and 64.")
+          : 0;
+  if(numThreads > MAX_COMPRESSION_THREADS)
+  {
+    throw IgorException(kParameterOutOfRange, "/THREADS must be an integer between 0 and 64.");
+  }
+  const auto directChunks =
+      p->DIRECTFlagEncountered ? ConvertFromDouble<int>(p->directChunks, "/DIRECT must be 0 or 1.") : 1;
+  if(directChunks != 0 && directChunks != 1)
+  {
+    throw IgorException(kParameterOutOfRange, "/DIRECT must be 0 or 1.");
+  }
+  const auto inMemory = p->INMEMFlagEncountered ? ConvertFromDouble<int>(p->inMemory, "/INMEM must be 0 or 1.") : 0;
+  if(inMemory != 0 && inMemory != 1)
+  {
+    throw IgorException(kParameterOutOfRange, "/INMEM must be 0 or 1.");
+  }
+  const auto maxMemory =
+      p->MAXMEMFlagEncountered
+          ? ConvertFromDouble<hsize_t>(p->maxMemory, "/MAXMEM must be a non-negative number of bytes.")
+          : 0;
+
+  try
+  {
+    // shrinking the pool or its memory can close files
+    auto hdf5Lock = LockHDF5();
+    std::unique_lock<std::mutex> lock(m_stateMutex);
+
+    // only pooled files are held in memory, unpooled ones would be read and written as a whole on every call
+    const bool inMemoryAfter = p->INMEMFlagEncountered ? inMemory != 0 : m_filePool.GetInMemory();
+    const auto poolSizeAfter = p->POOLFlagEncountered ? poolSize : m_filePool.GetCapacity();
+    if(inMemoryAfter && poolSizeAfter == 0)
+    {
+      throw IgorException(ERR_FLAGPARAMS, "/INMEM=1 needs the file pool, set /POOL to at least 1.");
+    }
+
+    if(p->IDLEFlagEncountered)
+    {
+      m_filePool.SetIdleTimeout(std::chrono::milliseconds(idleTimeout));
+    }
+
+    if(p->BUFROWSFlagEncountered)
+    {
+      m_bufferMaxRows = bufferRows;
+    }
+
+    if(p->BUFBYTESFlagEncountered)
+    {
+      m_bufferMaxBytes = bufferBytes;
+    }
+
+    if(p->POOLFlagEncountered)
+    {
+      m_filePool.SetCapacity(poolSize);
+    }
+
+    if(p->LATESTFlagEncountered)
+    {
+      m_latestFormat = latestFormat;
+    }
+
+    if(p->THREADSFlagEncountered)
+    {
+      m_numThreads = numThreads;
+    }
+
+    if(p->DIRECTFlagEncountered)
+    {
+      m_directChunks = directChunks != 0;
+    }
+
+    // leaving memory mode and lowering the limit write file images to disk
+    if(p->MAXMEMFlagEncountered)
+    {
+      m_filePool.SetMemoryLimit(maxMemory);
+    }
+
+    if(p->INMEMFlagEncountered)
+    {
+      m_filePool.SetInMemory(inMemory != 0);
+    }
+
+    lock.unlock();
+    CloseRemovedFiles();
+  }
+  catch(H5::Exception const &ex)
+  {
+    throw IgorException(ERR_HDF5, ex.getCDetailMsg());
+  }
+}
+
+void Handler::IPNWB_WriteEpochs(IPNWB_WriteEpochsRuntimeParamsPtr p)
+{
+  if(!p->STARTFlagEncountered || !p->STOPFlagEncountered || !p->TAGSFlagEncountered || !p->SFlagEncountered ||
+     !p->CFlagEncountered || !p->REFFlagEncountered || !p->LOCFlagEncountered || !p->fullFileNameEncountered)
+  {
+    throw IgorException(ERR_FLAGPARAMS, "Parameter(s) missing.");
+  }
+
+  auto fileName = GetStringFromHandle(p->fullFileName);
+  if(fileName.empty())
+  {
+    throw IgorException(ERR_INVALID_TYPE, "File name missing.");
+  }
+  auto tablePath = GetStringFromHandle(p->tablePath);
+  if(tablePath.empty())
+  {
+    throw IgorException(ERR_INVALID_TYPE, "HDF5 table path missing.");
+  }
+
+  const auto numRows = CheckInputWave(p->startWave, NT_FP64, "Start time");
+  if(CheckInputWave(p->stopWave, NT_FP64, "Stop time") != numRows)
+  {
+    throw IgorException(ERR_INVALID_TYPE, "Start and stop time waves must have the same size");
+  }
+
+  const auto numTags = CheckInputWave(p->tagsWave, TEXT_WAVE_TYPE, "Tags");
+  if(p->TAGCFlagEncountered && CheckInputWave(p->tagCountWave, NT_I32, "Tag count") != numRows)
+  {
+    throw IgorException(ERR_INVALID_TYPE, "Tag count wave must have one row per epoch");
+  }
+
+  const auto numTimeSeries = CheckInputWave(p->tsRefWave, TEXT_WAVE_TYPE, "Reference");
+  if(CheckInputWave(p->sizeWave, NT_I32, "Size", NT_I64) != numTimeSeries ||
+     CheckInputWave(p->offsetWave, NT_I32, "Offset", NT_I64) != numTimeSeries)
+  {
+    throw IgorException(ERR_INVALID_TYPE, "Waves must have the same size");
+  }
+  if(p->TSCFlagEncountered && CheckInputWave(p->tsCountWave, NT_I32, "Timeseries count") != numRows)
+  {
+    throw IgorException(ERR_INVALID_TYPE, "Timeseries count wave must have one row per epoch");
+  }
+
+  if(p->IDFlagEncountered && CheckInputWave(p->idWave, NT_I32, "Id") != numRows)
+  {
+    throw IgorException(ERR_INVALID_TYPE, "Id wave must have one row per epoch");
+  }
+  if(p->TREEFlagEncountered && CheckInputWave(p->treeLevelWave, NT_I32, "Tree level") != numRows)
+  {
+    throw IgorException(ERR_INVALID_TYPE, "Tree level wave must have one row per epoch");
+  }
+
+  auto options = GetConfiguredOptions();
+  ReadFilterOptions(p, options);
+  ReadLatestFormat(p, options);
+  options.wideIndices = p->WIDEFlagEncountered != 0;
+
+  TextWaveView tagsView(p->tagsWave);
+  std::vector<std::string> tags(numTags);
+  std::vector<const char *> tagPointers(numTags);
+  for(size_t i = 0; i < numTags; i++)
+  {
+    tags[i]        = std::string(tagsView[i]);
+    tagPointers[i] = tags[i].c_str();
+  }
+
+  // rows written with IPNWB_WriteCompound /ASYNC go before the new ones
+  m_asyncWriter.RunPending(fileName);
+
+  auto fileLock = m_fileLocks.Lock(fileName);
+
+  try
+  {
+    auto hdf5Lock = LockHDF5();
+
+    // rows written with IPNWB_WriteCompound /BUFFER go before the new ones
+    FlushStagedRows(fileName, tablePath + "/" + COLUMN_TIMESERIES);
+
+    auto filePtr = OpenFile(fileName, FilePool::Mode::ReadWrite);
+    auto &file   = *filePtr;
+
+    // the table group is created before any column
+    ApplyFileFormat(file, options.latestFormat);
+
+    H5::Group table = file.exists(tablePath) ? file.openGroup(tablePath) : file.createGroup(tablePath);
+
+    // check that the existing columns agree before anything is written
+    const auto oldRows = GetAppendableSize(table, COLUMN_ID);
+    for(const auto &name : {COLUMN_START_TIME, COLUMN_STOP_TIME, COLUMN_TAGS_INDEX, COLUMN_TIMESERIES_INDEX})
+    {
+      if(GetAppendableSize(table, name) != oldRows)
+      {
+        throw IgorException(ERR_INVALID_TYPE,
+                            "Column {} does not have the same size as column {}."_format(name, COLUMN_ID));
+      }
+    }
+
+    const bool hasTreeLevel = table.exists(COLUMN_TREELEVEL);
+    if(hasTreeLevel && !p->TREEFlagEncountered)
+    {
+      throw IgorException(ERR_FLAGPARAMS, "The table has a {} column, /TREE is required."_format(COLUMN_TREELEVEL));
+    }
+    if((hasTreeLevel || p->TREEFlagEncountered) && GetAppendableSize(table, COLUMN_TREELEVEL) != oldRows)
+    {
+      throw IgorException(ERR_INVALID_TYPE,
+                          "Column {} does not have the same size as column {}."_format(COLUMN_TREELEVEL, COLUMN_ID));
+    }
+
+    const auto lastTagsIndex = ReadLastIndex(table, COLUMN_TAGS_INDEX, oldRows);
+    if(GetAppendableSize(table, COLUMN_TAGS) != static_cast<hsize_t>(lastTagsIndex))
+    {
+      throw IgorException(ERR_INVALID_TYPE,
+                          "Column {} does not match column {}."_format(COLUMN_TAGS_INDEX, COLUMN_TAGS));
+    }
+    const auto lastTimeSeriesIndex = ReadLastIndex(table, COLUMN_TIMESERIES_INDEX, oldRows);
+    if(GetAppendableSize(table, COLUMN_TIMESERIES) != static_cast<hsize_t>(lastTimeSeriesIndex))
+    {
+      throw IgorException(ERR_INVALID_TYPE,
+                          "Column {} does not match column {}."_format(COLUMN_TIMESERIES_INDEX, COLUMN_TIMESERIES));
+    }
+
+    const auto tagCounts = p->TAGCFlagEncountered ? static_cast<const int *>(WaveData(p->tagCountWave)) : nullptr;
+    const auto tagsIndex = GetRaggedIndices(tagCounts, numRows, lastTagsIndex, numTags, COLUMN_TAGS);
+    const auto tsCounts  = p->TSCFlagEncountered ? static_cast<const int *>(WaveData(p->tsCountWave)) : nullptr;
+    const auto tsIndex   = GetRaggedIndices(tsCounts, numRows, lastTimeSeriesIndex, numTimeSeries, COLUMN_TIMESERIES);
+
+    const auto idWaveData = p->IDFlagEncountered ? static_cast<const int *>(WaveData(p->idWave)) : nullptr;
+    std::vector<int64_t> ids(numRows);
+    for(size_t i = 0; i < numRows; i++)
+    {
+      ids[i] = idWaveData == nullptr ? static_cast<int64_t>(oldRows + i) : idWaveData[i];
+    }
+
+    // the Igor side creates these columns as 32bit signed integers
+    const auto indexType = H5::PredType::STD_I32LE;
+
+    auto checkRange = [&table, &indexType](const std::vector<int64_t> &values, const std::string &name,
+                                           const std::string &what) {
+      if(values.empty())
+      {
+        return;
+      }
+
+      const auto range  = GetIntegerRange(table, name, indexType);
+      const auto minMax = std::minmax_element(values.begin(), values.end());
+      if(*minMax.first < range.first || *minMax.second > range.second)
+      {
+        throw IgorException(kParameterOutOfRange, "Column {} can not hold the new {}."_format(name, what));
+      }
+    };
+
+    checkRange(ids, COLUMN_ID, "ids");
+    checkRange(tagsIndex, COLUMN_TAGS_INDEX, "indices");
+    checkRange(tsIndex, COLUMN_TIMESERIES_INDEX, "indices");
+
+    TextWaveView tsRefs(p->tsRefWave);
+    const auto offsets = GetIntColumn(p->offsetWave);
+    const auto sizes   = GetIntColumn(p->sizeWave);
+    std::vector<hobj_ref_t> refs(numTimeSeries);
+    ReferenceCache refCache(file);
+    for(size_t i = 0; i < numTimeSeries; i++)
+    {
+      refs[i] = refCache.Get(tsRefs[i]);
+    }
+
+    const bool needs64Bit   = Needs64Bit(offsets, numTimeSeries) || Needs64Bit(sizes, numTimeSeries);
+    const auto compFileType = GetCompoundFileTypeForAppend(table, COLUMN_TIMESERIES, options.wideIndices, needs64Bit);
+
+    const auto doubleType = H5::PredType::IEEE_F64LE;
+    const auto int64Type  = H5::PredType::NATIVE_INT64;
+    H5::StrType tagsType(H5::PredType::C_S1, H5T_VARIABLE);
+    tagsType.setCset(H5T_CSET_UTF8);
+    if(table.exists(COLUMN_TAGS))
+    {
+      // HDF5 does not convert between character sets
+      H5::DataSet tagsDataSet = table.openDataSet(COLUMN_TAGS);
+      if(tagsDataSet.getTypeClass() != H5T_STRING || !tagsDataSet.getStrType().isVariableStr())
+      {
+        throw IgorException(ERR_INVALID_TYPE, "Column {} must have a variable length string type."_format(COLUMN_TAGS));
+      }
+      tagsType = tagsDataSet.getStrType();
+    }
+
+    // all checks are done, if an append fails nonetheless the columns are reverted to these rows
+    const std::vector<std::pair<std::string, hsize_t>> oldSizes = {
+        {COLUMN_START_TIME, oldRows},
+        {COLUMN_STOP_TIME, oldRows},
+        {COLUMN_TAGS, static_cast<hsize_t>(lastTagsIndex)},
+        {COLUMN_TAGS_INDEX, oldRows},
+        {COLUMN_TIMESERIES, static_cast<hsize_t>(lastTimeSeriesIndex)},
+        {COLUMN_TIMESERIES_INDEX, oldRows},
+        {COLUMN_TREELEVEL, oldRows},
+        {COLUMN_ID, oldRows}};
+    std::set<std::string> newColumns;
+    for(const auto &elem : oldSizes)
+    {
+      if(!table.exists(elem.first))
+      {
+        newColumns.insert(elem.first);
+      }
+    }
+
+    try
+    {
+      AppendToDataSet(table, COLUMN_START_TIME, H5::PredType::NATIVE_DOUBLE, doubleType, WaveData(p->startWave),
+                      numRows, options);
+      AppendToDataSet(table, COLUMN_STOP_TIME, H5::PredType::NATIVE_DOUBLE, doubleType, WaveData(p->stopWave),
+                      numRows, options);
+      AppendToDataSet(table, COLUMN_TAGS, tagsType, tagsType, tagPointers.data(), numTags, options);
+      AppendToDataSet(table, COLUMN_TAGS_INDEX, int64Type, indexType, tagsIndex.data(), numRows, options);
+      AppendCompoundRows(table, COLUMN_TIMESERIES, compFileType, offsets, sizes, refs, options, m_stats);
+      AppendToDataSet(table, COLUMN_TIMESERIES_INDEX, int64Type, indexType, tsIndex.data(), numRows, options);
+      if(p->TREEFlagEncountered)
+      {
+        AppendToDataSet(table, COLUMN_TREELEVEL, H5::PredType::NATIVE_INT32, indexType, WaveData(p->treeLevelWave),
+                        numRows, options);
+      }
+      // id last, it defines the number of rows of the table
+      AppendToDataSet(table, COLUMN_ID, int64Type, indexType, ids.data(), numRows, options);
+    }
+    catch(...)
+    {
+      // the failed append reverted itself, the error of the append is reported and not the one of the revert
+      for(const auto &elem : oldSizes)
+      {
+        try
+        {
+          if(!table.exists(elem.first))
+          {
+            continue;
+          }
+
+          if(newColumns.count(elem.first) != 0)
+          {
+            table.unlink(elem.first);
+          }
+          else
+          {
+            TruncateDataSet(table, elem.first, elem.second);
+          }
+        }
+        catch(...)
+        {
+        }
+      }
+
+      throw;
+    }
+
+    SetOperationReturn("V_numRows", static_cast<double>(oldRows + numRows));
+  }
+  catch(H5::Exception const &ex)
+  {
+    throw IgorException(ERR_HDF5, ex.getCDetailMsg());
+  }
+}
+
+void Handler::IPNWB_WaitWrites(IPNWB_WaitWritesRuntimeParamsPtr /*p*/)
+{
+  // waits for the current write of the writer thread, the remaining writes run here
+  m_asyncWriter.RunPending();
+
+  SetOperationReturn("V_numErrors", static_cast<double>(m_asyncWriter.GetNumErrors()));
+}
+
+void Handler::IPNWB_GetWriteErrors(IPNWB_GetWriteErrorsRuntimeParamsPtr p)
+{
+  if(!p->errorWaveEncountered)
+  {
+    throw IgorException(ERR_FLAGPARAMS, "Parameter(s) missing.");
+  }
+
+  const auto errors = m_asyncWriter.TakeErrors();
+
+  auto dimCnt = std::vector<CountInt>(MAX_DIMENSIONS + 1, 0);
+  dimCnt[0]   = errors.size();
+
+  auto checkWaveProperties = [](waveHndl w) {
+    if(WaveType(w) != TEXT_WAVE_TYPE)
+    {
+      throw IgorException(ERR_INVALID_TYPE, "Only text waves are supported.");
+    }
+  };
+
+  auto typeGetter = [](waveHndl /*unused*/) { return TEXT_WAVE_TYPE; };
+
+  auto setWaveContents = [&](waveHndl w) { StringVectorToTextWave(errors, w); };
+
+  HandleDestWave(p->errorWaveParamsSet[0], p->errorWave, p->FREEFlagEncountered, dimCnt, checkWaveProperties,
+                 typeGetter, setWaveContents);
+
+  SetOperationReturn("V_numErrors", static_cast<double>(errors.size()));
+}
+
+void Handler::IPNWB_Finalize(IPNWB_FinalizeRuntimeParamsPtr p)
+{
+  if(!p->fullFileNameEncountered)
+  {
+    throw IgorException(ERR_FLAGPARAMS, "Parameter(s) missing.");
+  }
+  auto fileName = GetStringFromHandle(p->fullFileName);
+  if(fileName.empty())
+  {
+    throw IgorException(ERR_INVALID_TYPE, "File name missing.");
+  }
+  const auto compPath = p->LOCFlagEncountered ? GetStringFromHandle(p->compPath) : std::string();
+  if(p->LOCFlagEncountered && compPath.empty())
+  {
+    throw IgorException(ERR_INVALID_TYPE, "HDF5 data path missing.");
+  }
+
+  // buffered and queued rows must be written before the datasets are trimmed
+  m_asyncWriter.RunPending(fileName);
+
+  auto fileLock = m_fileLocks.Lock(fileName);
+
+  try
+  {
+    std::size_t numFinalized = 0;
+
+    {
+      auto hdf5Lock = LockHDF5();
+
+      FlushStagedRows(fileName);
+
+      auto filePtr = OpenFile(fileName, FilePool::Mode::ReadWrite);
+      if(compPath.empty())
+      {
+        numFinalized = FinalizeFile(*filePtr);
+      }
+      else
+      {
+        if(!filePtr->exists(compPath))
+        {
+          throw IgorException(ERR_INVALID_TYPE, "HDF5 data not present at given path.");
+        }
+        numFinalized = FinalizeDataSet(filePtr->openDataSet(compPath)) ? 1 : 0;
+      }
+    }
+
+    SetOperationReturn("V_numFinalized", static_cast<double>(numFinalized));
+  }
+  catch(H5::Exception const &ex)
+  {
+    throw IgorException(ERR_HDF5, ex.getCDetailMsg());
+  }
+}
+
+void Handler::IPNWB_ResetStats(IPNWB_ResetStatsRuntimeParamsPtr /*p*/)
+{
+  m_stats.Reset();
+}
+
+void Handler::IPNWB_GetStats(IPNWB_GetStatsParamsPtr p)
+{
+  // one row per phase, keyed by the phase name
+  const std::vector<std::string> columns = {"calls", "seconds", "rows", "bytes"};
+  std::vector<std::string> phases;
+
+  CountInt dimCnt[MAX_DIMENSIONS + 1] = {};
+  dimCnt[ROWS]                        = static_cast<CountInt>(Stats::NUM_PHASES);
+  dimCnt[COLUMNS]                     = static_cast<CountInt>(columns.size());
+
+  waveHndl w = nullptr;
+  if(int err = MDMakeWave(&w, "stats", reinterpret_cast<DataFolderHandle>(-1), dimCnt, NT_FP64, 1))
+  {
+    throw IgorException(err, "Could not create the statistics wave.");
+  }
+
+  auto data = static_cast<double *>(WaveData(w));
+  for(size_t i = 0; i < Stats::NUM_PHASES; i++)
+  {
+    const auto phase    = static_cast<Stats::Phase>(i);
+    const auto snapshot = m_stats.Get(phase);
+
+    data[i]                         = static_cast<double>(snapshot.calls);
+    data[i + Stats::NUM_PHASES]     = static_cast<double>(snapshot.nanoseconds) * 1e-9;
+    data[i + 2 * Stats::NUM_PHASES] = static_cast<double>(snapshot.rows);
+    data[i + 3 * Stats::NUM_PHASES] = static_cast<double>(snapshot.bytes);
+
+    phases.push_back(Stats::GetPhaseName(phase));
+  }
+
+  SetDimensionLabels(w, ROWS, phases);
+  SetDimensionLabels(w, COLUMNS, columns);
+
+  p->result = w;
+}
+
+void Handler::CloseAllFiles()
+{
+  auto closeAll = [this] {
+    auto hdf5Lock = LockHDF5();
+    {
+      StateLock lock(m_stateMutex);
+      m_filePool.CloseAll();
+    }
+    CloseRemovedFiles();
+  };
+
+  try
+  {
+    m_asyncWriter.RunPending();
+    FlushAllStagedRows();
+  }
+  catch(...)
+  {
+    closeAll();
+    throw;
+  }
+
+  closeAll();
+}
+
+void Handler::CloseIdleFiles()
+{
+  // called from Igor's main thread, which must not wait for running operations
+  std::unique_lock<std::recursive_mutex> hdf5Lock(m_hdf5Mutex, std::defer_lock);
+  if(!IsHDF5ThreadSafe() && !hdf5Lock.try_lock())
+  {
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(m_stateMutex, std::try_to_lock);
+  if(!lock.owns_lock())
+  {
+    return;
+  }
+
+  m_filePool.CloseIdle();
+  auto files = m_filePool.TakeClosedFiles();
+  lock.unlock();
+
+  FilePool::CloseFiles(std::move(files));
+}
+
+void Handler::StopAsyncWriter()
+{
+  m_asyncWriter.Stop();
+}
+
+std::unique_lock<std::recursive_mutex> Handler::LockHDF5()
+{
+  if(IsHDF5ThreadSafe())
+  {
+    return {};
+  }
+
+  return std::unique_lock<std::recursive_mutex>(m_hdf5Mutex);
+}
+
+std::shared_ptr<H5::H5File> Handler::OpenFile(const std::string &fileName, FilePool::Mode mode)
+{
+  bool inMemory = false;
+  std::shared_ptr<H5::H5File> filePtr;
+  {
+    StateLock lock(m_stateMutex);
+    filePtr = m_filePool.Find(fileName, mode, inMemory);
+  }
+
+  // also closes a file pooled read-only before it is opened for read/write
+  CloseRemovedFiles();
+
+  if(filePtr)
+  {
+    return filePtr;
+  }
+
+  filePtr = FilePool::OpenFile(fileName, mode, inMemory);
+  {
+    StateLock lock(m_stateMutex);
+    filePtr = m_filePool.Add(fileName, mode, inMemory, std::move(filePtr));
+  }
+  CloseRemovedFiles();
+
+  return filePtr;
+}
+
+void Handler::CloseRemovedFiles()
+{
+  FilePool::Files files;
+  {
+    StateLock lock(m_stateMutex);
+    files = m_filePool.TakeClosedFiles();
+  }
+
+  FilePool::CloseFiles(std::move(files));
 }
 
 void Handler::SetQuietMode(bool quietMode)
@@ -1,8 +1,27 @@
 #pragma once
 
+#include "AsyncWriter.h"
+#include "CompoundEngine.h"
+#include "FileLocks.h"
+#include "FilePool.h"
+#include "FileUtils.h"
 #include "Operations.h"
+#include "ReferenceCache.h"
+#include "Stats.h"
 #include "functions.h"
 
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
 class Handler
 {
 public:
@@ -17,11 +36,145 @@ public:
 
   void IPNWB_ReadCompound(IPNWB_ReadCompoundRuntimeParamsPtr p);
 
+  void IPNWB_CompoundInfo(IPNWB_CompoundInfoRuntimeParamsPtr p);
+
+  void IPNWB_CloseFile(IPNWB_CloseFileRuntimeParamsPtr p);
+
+  void IPNWB_FlushAll(IPNWB_FlushAllRuntimeParamsPtr p);
+
+  void IPNWB_Configure(IPNWB_ConfigureRuntimeParamsPtr p);
+
+  void IPNWB_WriteEpochs(IPNWB_WriteEpochsRuntimeParamsPtr p);
+
+  void IPNWB_WaitWrites(IPNWB_WaitWritesRuntimeParamsPtr p);
+
+  void IPNWB_GetWriteErrors(IPNWB_GetWriteErrorsRuntimeParamsPtr p);
+
+  void IPNWB_ResetStats(IPNWB_ResetStatsRuntimeParamsPtr p);
+
+  void IPNWB_Finalize(IPNWB_FinalizeRuntimeParamsPtr p);
+
+  /// Close all pooled files, called on XOP cleanup
+  void CloseAllFiles();
+
+  /// Close pooled files exceeding the idle timeout, called on XOP idle
+  void CloseIdleFiles();
+
+  /// Stop the writer thread of IPNWB_WriteCompound /ASYNC
+  void StopAsyncWriter();
+
   // Functions
+  void IPNWB_GetStats(IPNWB_GetStatsParamsPtr p);
 
 private:
-  Handler()        = default;
-  bool m_quietMode = false;
+  Handler() = default;
+  std::atomic<bool> m_quietMode{false};
+
+  // Locking
+  //
+  // Operations lock the file they work on, so operations on different files
+  // run in parallel. If the HDF5 library is not built thread-safe, all HDF5
+  // calls, including dropping the last reference to an HDF5 object, are
+  // additionally serialized with the HDF5 lock. Validating and filling waves
+  // happens outside of it. m_stateMutex guards the containers below and is
+  // only held briefly, files of the pool are opened and closed without it.
+  //
+  // Lock order: file lock, HDF5 lock, m_stateMutex. Pending asynchronous
+  // writes must be run before taking a file lock, as they lock files
+  // themselves.
+
+  /// Return the lock of the HDF5 library, an empty lock if the library is thread-safe
+  std::unique_lock<std::recursive_mutex> LockHDF5();
+
+  /// Return an open file from the pool, the HDF5 lock must be held
+  std::shared_ptr<H5::H5File> OpenFile(const std::string &fileName, FilePool::Mode mode);
+
+  /// Close the files removed from the pool, the HDF5 lock must be held and m_stateMutex must not
+  void CloseRemovedFiles();
+
+  FileLocks m_fileLocks;
+  std::recursive_mutex m_hdf5Mutex;
+  std::mutex m_stateMutex;
+
+  /// Writes of IPNWB_WriteCompound /ASYNC
+  AsyncWriter m_asyncWriter;
+
+  FilePool m_filePool;
+
+  /// Phase counters of IPNWB_WriteCompound and IPNWB_ReadCompound, see IPNWB_GetStats()
+  Stats m_stats;
+
+  /// Append rows to the compound dataset, creating it if necessary, the file lock and the HDF5 lock must be held
+  CompoundEngine::AppendResult AppendRows(const std::string &fileName, const std::string &compPath,
+                                          const CompoundEngine::CreationOptions &options,
+                                          const CompoundEngine::CompoundRows &rows, bool useRefCache);
+
+  /// Rows buffered with IPNWB_WriteCompound /BUFFER for one dataset
+  struct StagedRows
+  {
+    std::string fileName;
+    std::string compPath;
+    CompoundEngine::CreationOptions options;
+    bool useRefCache = true;
+    std::vector<int64_t> offsets;
+    std::vector<int64_t> sizes;
+    std::vector<std::string> refs;
+    std::size_t numBytes = 0;
+    std::set<std::string, std::less<>> checkedRefs; ///< paths known to reference existing objects
+    bool allows64Bit = true;                        ///< false if the dataset exists with 32bit offset and size members
+  };
+
+  /// canonical file path and dataset path
+  using StagedKey = std::pair<std::string, std::string>;
+
+  /// Buffer rows, flushes them when a threshold is reached, the file lock must be held
+  ///
+  /// Rows buffered with different options are written first. The referenced
+  /// paths, the schema of an existing dataset and whether the offsets and
+  /// sizes fit into it are checked here, so that a bad row fails its own call
+  /// and not the write of all buffered rows.
+  ///
+  /// @return number of rows still buffered for the dataset
+  std::size_t StageRows(const std::string &fileName, const std::string &compPath,
+                        const CompoundEngine::CreationOptions &options, bool useRefCache,
+                        const CompoundEngine::CompoundRows &rows);
+
+  /// Write buffered rows, the file lock and the HDF5 lock must be held
+  ///
+  /// Rows which can not be written nonetheless are dropped, the error naming the dataset is reported by
+  /// IPNWB_GetWriteErrors.
+  void WriteStagedRows(StagedRows &&staged);
+  void FlushStagedRows(const std::string &fileName, const std::string &compPath);
+  void FlushStagedRows(const std::string &fileName);
+
+  /// Write all buffered rows, must be called without holding a file lock
+  void FlushAllStagedRows();
+
+  std::map<StagedKey, StagedRows> m_stagedRows;
+  std::size_t m_bufferMaxRows  = 4096;
+  std::size_t m_bufferMaxBytes = 1024 * 1024;
+
+  /// Dereference cache kept across IPNWB_ReadCompound calls with /CACHE
+  struct PersistentDereferenceCache
+  {
+    FileStamp stamp;
+    uint64_t lastUsed = 0;
+    std::shared_ptr<DereferenceCache> cache;
+  };
+
+  std::shared_ptr<DereferenceCache> GetPersistentDereferenceCache(const std::string &fileName);
+
+  /// keyed by canonical file path
+  std::map<std::string, PersistentDereferenceCache> m_dereferenceCaches;
+  uint64_t m_dereferenceCacheUseCount = 0;
+
+  /// Return the options of new datasets and appends set with IPNWB_Configure /LATEST, /THREADS and /DIRECT
+  CompoundEngine::CreationOptions GetConfiguredOptions();
+
+  /// the version bounds of files are left alone until /LATEST is given
+  CompoundEngine::LatestFormat m_latestFormat = CompoundEngine::LatestFormat::Keep;
+  unsigned int m_numThreads                   = 0;
+  bool m_directChunks                         = true;
 };
 
 Handler &XOPHandler();
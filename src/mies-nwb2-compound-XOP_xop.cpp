@@ -7,23 +7,26 @@
 #include "Helpers.h"
 #include "xop_errors.h"
 
-#include <mutex>
+// FUNCTIONS
 
-namespace
+extern "C" int IPNWB_GetStats(IPNWB_GetStatsParamsPtr p)
 {
-using LockGuard = std::lock_guard<std::recursive_mutex>;
-std::recursive_mutex mutex;
-} // namespace
+  BEGIN_OUTER_CATCH
 
-// FUNCTIONS
+  p->result = nullptr;
+  XOPHandler().IPNWB_GetStats(p);
+
+  END_OUTER_CATCH
+}
 
 // OPERATIONS
 
+// the handler locks the files the operations work on, see Handler
+
 extern "C" int ExecuteIPNWB_WriteCompound(IPNWB_WriteCompoundRuntimeParamsPtr p)
 {
   BEGIN_OUTER_CATCH
 
-  LockGuard lock(mutex);
   XOPHandler().IPNWB_WriteCompound(p);
 
   END_OUTER_CATCH
@@ -33,12 +36,92 @@ extern "C" int ExecuteIPNWB_ReadCompound(IPNWB_ReadCompoundRuntimeParamsPtr p)
 {
   BEGIN_OUTER_CATCH
 
-  LockGuard lock(mutex);
   XOPHandler().IPNWB_ReadCompound(p);
 
   END_OUTER_CATCH
 }
 
+extern "C" int ExecuteIPNWB_CompoundInfo(IPNWB_CompoundInfoRuntimeParamsPtr p)
+{
+  BEGIN_OUTER_CATCH
+
+  XOPHandler().IPNWB_CompoundInfo(p);
+
+  END_OUTER_CATCH
+}
+
+extern "C" int ExecuteIPNWB_CloseFile(IPNWB_CloseFileRuntimeParamsPtr p)
+{
+  BEGIN_OUTER_CATCH
+
+  XOPHandler().IPNWB_CloseFile(p);
+
+  END_OUTER_CATCH
+}
+
+extern "C" int ExecuteIPNWB_FlushAll(IPNWB_FlushAllRuntimeParamsPtr p)
+{
+  BEGIN_OUTER_CATCH
+
+  XOPHandler().IPNWB_FlushAll(p);
+
+  END_OUTER_CATCH
+}
+
+extern "C" int ExecuteIPNWB_Configure(IPNWB_ConfigureRuntimeParamsPtr p)
+{
+  BEGIN_OUTER_CATCH
+
+  XOPHandler().IPNWB_Configure(p);
+
+  END_OUTER_CATCH
+}
+
+extern "C" int ExecuteIPNWB_WriteEpochs(IPNWB_WriteEpochsRuntimeParamsPtr p)
+{
+  BEGIN_OUTER_CATCH
+
+  XOPHandler().IPNWB_WriteEpochs(p);
+
+  END_OUTER_CATCH
+}
+
+extern "C" int ExecuteIPNWB_WaitWrites(IPNWB_WaitWritesRuntimeParamsPtr p)
+{
+  BEGIN_OUTER_CATCH
+
+  XOPHandler().IPNWB_WaitWrites(p);
+
+  END_OUTER_CATCH
+}
+
+extern "C" int ExecuteIPNWB_GetWriteErrors(IPNWB_GetWriteErrorsRuntimeParamsPtr p)
+{
+  BEGIN_OUTER_CATCH
+
+  XOPHandler().IPNWB_GetWriteErrors(p);
+
+  END_OUTER_CATCH
+}
+
+extern "C" int ExecuteIPNWB_Finalize(IPNWB_FinalizeRuntimeParamsPtr p)
+{
+  BEGIN_OUTER_CATCH
+
+  XOPHandler().IPNWB_Finalize(p);
+
+  END_OUTER_CATCH
+}
+
+extern "C" int ExecuteIPNWB_ResetStats(IPNWB_ResetStatsRuntimeParamsPtr p)
+{
+  BEGIN_OUTER_CATCH
+
+  XOPHandler().IPNWB_ResetStats(p);
+
+  END_OUTER_CATCH
+}
+
 static int RegisterIPNWB_WriteCompound(void)
 {
   const char *cmdTemplate;
@@ -47,8 +130,9 @@ static int RegisterIPNWB_WriteCompound(void)
 
   // NOTE: If you change this template, you must change the IPNWB_WriteCompoundRuntimeParams structure as well.
   cmdTemplate = "IPNWB_WriteCompound /Z[=number:ZIn] /Q[=number:QIn] /S=wave:offsetWave /C=wave:sizeWave "
-                "/REF=wave:tsRefWave /LOC=string:compPath string:fullFileName";
-  runtimeNumVarList = "V_flag;";
+                "/REF=wave:tsRefWave /LOC=string:compPath /CHUNK=number:chunkSize /NOCACHE /BUFFER "
+                "/COMP=number:compLevel /SHUF /ASYNC /WIDE /LATEST=number:latestFormat /GROW string:fullFileName";
+  runtimeNumVarList = "V_flag;V_refCacheHits;V_refCacheMisses;V_pendingRows;V_pendingWrites;";
   runtimeStrVarList = "";
   return RegisterOperation(cmdTemplate, runtimeNumVarList, runtimeStrVarList, sizeof(IPNWB_WriteCompoundRuntimeParams),
                            (void *) ExecuteIPNWB_WriteCompound, kOperationIsThreadSafe);
@@ -63,13 +147,148 @@ static int RegisterIPNWB_ReadCompound(void)
   // NOTE: If you change this template, you must change the IPNWB_ReadCompoundRuntimeParams structure as well.
   cmdTemplate = "IPNWB_ReadCompound /Z[=number:ZIn] /Q[=number:QIn] /FREE /S=DataFolderAndName:{offsetWave, real} "
                 "/C=DataFolderAndName:{sizeWave, real} /REF=DataFolderAndName:{tsRefWave, text} /LOC=string:compPath "
-                "string:fullFileName";
-  runtimeNumVarList = "V_flag;";
+                "/CACHE /RANGE={number:rangeStart, number:rangeCount} /REFI=DataFolderAndName:{refIndexWave, real} "
+                "/IMG=wave:imageWave [string:fullFileName]";
+  runtimeNumVarList = "V_flag;V_refCacheHits;V_refCacheMisses;";
   runtimeStrVarList = "";
   return RegisterOperation(cmdTemplate, runtimeNumVarList, runtimeStrVarList, sizeof(IPNWB_ReadCompoundRuntimeParams),
                            (void *) ExecuteIPNWB_ReadCompound, kOperationIsThreadSafe);
 }
 
+static int RegisterIPNWB_CompoundInfo(void)
+{
+  const char *cmdTemplate;
+  const char *runtimeNumVarList;
+  const char *runtimeStrVarList;
+
+  // NOTE: If you change this template, you must change the IPNWB_CompoundInfoRuntimeParams structure as well.
+  cmdTemplate = "IPNWB_CompoundInfo /Z[=number:ZIn] /Q[=number:QIn] /FREE /LOC=string:compPath "
+                "/MEM=DataFolderAndName:{memberWave, text} string:fullFileName";
+  runtimeNumVarList =
+      "V_flag;V_numRows;V_capacity;V_rowSize;V_wide;V_storageSize;V_chunkSize;V_compLevel;V_shuffle;V_superblock;";
+  runtimeStrVarList = "S_filters;S_chunkIndex;";
+  return RegisterOperation(cmdTemplate, runtimeNumVarList, runtimeStrVarList, sizeof(IPNWB_CompoundInfoRuntimeParams),
+                           (void *) ExecuteIPNWB_CompoundInfo, kOperationIsThreadSafe);
+}
+
+static int RegisterIPNWB_CloseFile(void)
+{
+  const char *cmdTemplate;
+  const char *runtimeNumVarList;
+  const char *runtimeStrVarList;
+
+  // NOTE: If you change this template, you must change the IPNWB_CloseFileRuntimeParams structure as well.
+  cmdTemplate       = "IPNWB_CloseFile /Z[=number:ZIn] /Q[=number:QIn] /A [string:fullFileName]";
+  runtimeNumVarList = "V_flag;";
+  runtimeStrVarList = "";
+  return RegisterOperation(cmdTemplate, runtimeNumVarList, runtimeStrVarList, sizeof(IPNWB_CloseFileRuntimeParams),
+                           (void *) ExecuteIPNWB_CloseFile, kOperationIsThreadSafe);
+}
+
+static int RegisterIPNWB_FlushAll(void)
+{
+  const char *cmdTemplate;
+  const char *runtimeNumVarList;
+  const char *runtimeStrVarList;
+
+  // NOTE: If you change this template, you must change the IPNWB_FlushAllRuntimeParams structure as well.
+  cmdTemplate       = "IPNWB_FlushAll /Z[=number:ZIn] /Q[=number:QIn]";
+  runtimeNumVarList = "V_flag;";
+  runtimeStrVarList = "";
+  return RegisterOperation(cmdTemplate, runtimeNumVarList, runtimeStrVarList, sizeof(IPNWB_FlushAllRuntimeParams),
+                           (void *) ExecuteIPNWB_FlushAll, kOperationIsThreadSafe);
+}
+
+static int RegisterIPNWB_Configure(void)
+{
+  const char *cmdTemplate;
+  const char *runtimeNumVarList;
+  const char *runtimeStrVarList;
+
+  // NOTE: If you change this template, you must change the IPNWB_ConfigureRuntimeParams structure as well.
+  cmdTemplate = "IPNWB_Configure /Z[=number:ZIn] /Q[=number:QIn] /POOL=number:poolSize /IDLE=number:idleTimeout "
+                "/BUFROWS=number:bufferRows /BUFBYTES=number:bufferBytes /LATEST=number:latestFormat "
+                "/THREADS=number:numThreads /INMEM=number:inMemory /MAXMEM=number:maxMemory "
+                "/DIRECT=number:directChunks";
+  runtimeNumVarList = "V_flag;";
+  runtimeStrVarList = "";
+  return RegisterOperation(cmdTemplate, runtimeNumVarList, runtimeStrVarList, sizeof(IPNWB_ConfigureRuntimeParams),
+                           (void *) ExecuteIPNWB_Configure, kOperationIsThreadSafe);
+}
+
+static int RegisterIPNWB_WriteEpochs(void)
+{
+  const char *cmdTemplate;
+  const char *runtimeNumVarList;
+  const char *runtimeStrVarList;
+
+  // NOTE: If you change this template, you must change the IPNWB_WriteEpochsRuntimeParams structure as well.
+  cmdTemplate = "IPNWB_WriteEpochs /Z[=number:ZIn] /Q[=number:QIn] /START=wave:startWave /STOP=wave:stopWave "
+                "/TAGS=wave:tagsWave /TAGC=wave:tagCountWave /S=wave:offsetWave /C=wave:sizeWave /REF=wave:tsRefWave "
+                "/TSC=wave:tsCountWave /ID=wave:idWave /TREE=wave:treeLevelWave /LOC=string:tablePath "
+                "/COMP=number:compLevel /SHUF /WIDE /LATEST=number:latestFormat string:fullFileName";
+  runtimeNumVarList = "V_flag;V_numRows;";
+  runtimeStrVarList = "";
+  return RegisterOperation(cmdTemplate, runtimeNumVarList, runtimeStrVarList, sizeof(IPNWB_WriteEpochsRuntimeParams),
+                           (void *) ExecuteIPNWB_WriteEpochs, kOperationIsThreadSafe);
+}
+
+static int RegisterIPNWB_WaitWrites(void)
+{
+  const char *cmdTemplate;
+  const char *runtimeNumVarList;
+  const char *runtimeStrVarList;
+
+  // NOTE: If you change this template, you must change the IPNWB_WaitWritesRuntimeParams structure as well.
+  cmdTemplate       = "IPNWB_WaitWrites /Z[=number:ZIn] /Q[=number:QIn]";
+  runtimeNumVarList = "V_flag;V_numErrors;";
+  runtimeStrVarList = "";
+  return RegisterOperation(cmdTemplate, runtimeNumVarList, runtimeStrVarList, sizeof(IPNWB_WaitWritesRuntimeParams),
+                           (void *) ExecuteIPNWB_WaitWrites, kOperationIsThreadSafe);
+}
+
+static int RegisterIPNWB_GetWriteErrors(void)
+{
+  const char *cmdTemplate;
+  const char *runtimeNumVarList;
+  const char *runtimeStrVarList;
+
+  // NOTE: If you change this template, you must change the IPNWB_GetWriteErrorsRuntimeParams structure as well.
+  cmdTemplate       = "IPNWB_GetWriteErrors /Z[=number:ZIn] /Q[=number:QIn] /FREE DataFolderAndName:{errorWave, text}";
+  runtimeNumVarList = "V_flag;V_numErrors;";
+  runtimeStrVarList = "";
+  return RegisterOperation(cmdTemplate, runtimeNumVarList, runtimeStrVarList, sizeof(IPNWB_GetWriteErrorsRuntimeParams),
+                           (void *) ExecuteIPNWB_GetWriteErrors, kOperationIsThreadSafe);
+}
+
+static int RegisterIPNWB_Finalize(void)
+{
+  const char *cmdTemplate;
+  const char *runtimeNumVarList;
+  const char *runtimeStrVarList;
+
+  // NOTE: If you change this template, you must change the IPNWB_FinalizeRuntimeParams structure as well.
+  cmdTemplate       = "IPNWB_Finalize /Z[=number:ZIn] /Q[=number:QIn] /LOC=string:compPath string:fullFileName";
+  runtimeNumVarList = "V_flag;V_numFinalized;";
+  runtimeStrVarList = "";
+  return RegisterOperation(cmdTemplate, runtimeNumVarList, runtimeStrVarList, sizeof(IPNWB_FinalizeRuntimeParams),
+                           (void *) ExecuteIPNWB_Finalize, kOperationIsThreadSafe);
+}
+
+static int RegisterIPNWB_ResetStats(void)
+{
+  const char *cmdTemplate;
+  const char *runtimeNumVarList;
+  const char *runtimeStrVarList;
+
+  // NOTE: If you change this template, you must change the IPNWB_ResetStatsRuntimeParams structure as well.
+  cmdTemplate       = "IPNWB_ResetStats /Z[=number:ZIn] /Q[=number:QIn]";
+  runtimeNumVarList = "V_flag;";
+  runtimeStrVarList = "";
+  return RegisterOperation(cmdTemplate, runtimeNumVarList, runtimeStrVarList, sizeof(IPNWB_ResetStatsRuntimeParams),
+                           (void *) ExecuteIPNWB_ResetStats, kOperationIsThreadSafe);
+}
+
 static int RegisterOperations(void) // Register any operations with Igor.
 {
   int result;
@@ -80,6 +299,33 @@ static int RegisterOperations(void) // Register any operations with Igor.
   if(result = RegisterIPNWB_ReadCompound())
     return result;
 
+  if(result = RegisterIPNWB_CompoundInfo())
+    return result;
+
+  if(result = RegisterIPNWB_CloseFile())
+    return result;
+
+  if(result = RegisterIPNWB_FlushAll())
+    return result;
+
+  if(result = RegisterIPNWB_Configure())
+    return result;
+
+  if(result = RegisterIPNWB_WriteEpochs())
+    return result;
+
+  if(result = RegisterIPNWB_WaitWrites())
+    return result;
+
+  if(result = RegisterIPNWB_GetWriteErrors())
+    return result;
+
+  if(result = RegisterIPNWB_ResetStats())
+    return result;
+
+  if(result = RegisterIPNWB_Finalize())
+    return result;
+
   return 0;
 }
 
@@ -98,9 +344,34 @@ extern "C" void XOPEntry(void)
   case FUNCADDRS:
     result = RegisterFunction();
     break;
+  case IDLE:
+  {
+    // does not block Igor's main thread if an operation is running
+    try
+    {
+      XOPHandler().CloseIdleFiles();
+    }
+    catch(...)
+    {
+      // nothing we can do here
+    }
+    break;
+  }
   case CLEANUP:
+  {
+    XOPHandler().StopAsyncWriter();
+
+    try
+    {
+      XOPHandler().CloseAllFiles();
+    }
+    catch(...)
+    {
+      // nothing we can do here
+    }
     break;
   }
+  }
   SetXOPResult(result);
 }
 
@@ -118,8 +389,9 @@ HOST_IMPORT int XOPMain(IORecHandle ioRecHandle) // The use of XOPMain rather th
 {
   int result;
 
-  XOPInit(ioRecHandle);  // Do standard XOP initialization
-  SetXOPEntry(XOPEntry); // Set entry point for future calls
+  XOPInit(ioRecHandle);         // Do standard XOP initialization
+  SetXOPEntry(XOPEntry);        // Set entry point for future calls
+  SetXOPType(RESIDENT | IDLES); // Receive IDLE messages for closing idle files
 
 #if XOP_TOOLKIT_VERSION >= 800
   if(igorVersion < 800)
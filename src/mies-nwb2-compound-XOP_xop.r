@@ -49,6 +49,33 @@ resource 'XOPC' (1100) {
 	"IPNWB_ReadCompound",
 	utilOp + XOPOp + compilableOp + threadSafeOp,
 
+	"IPNWB_CompoundInfo",
+	utilOp + XOPOp + compilableOp + threadSafeOp,
+
+	"IPNWB_CloseFile",
+	utilOp + XOPOp + compilableOp + threadSafeOp,
+
+	"IPNWB_FlushAll",
+	utilOp + XOPOp + compilableOp + threadSafeOp,
+
+	"IPNWB_Configure",
+	utilOp + XOPOp + compilableOp + threadSafeOp,
+
+	"IPNWB_WriteEpochs",
+	utilOp + XOPOp + compilableOp + threadSafeOp,
+
+	"IPNWB_WaitWrites",
+	utilOp + XOPOp + compilableOp + threadSafeOp,
+
+	"IPNWB_GetWriteErrors",
+	utilOp + XOPOp + compilableOp + threadSafeOp,
+
+	"IPNWB_ResetStats",
+	utilOp + XOPOp + compilableOp + threadSafeOp,
+
+	"IPNWB_Finalize",
+	utilOp + XOPOp + compilableOp + threadSafeOp,
+
   }
 };
 
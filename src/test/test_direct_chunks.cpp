@@ -0,0 +1,259 @@
+/// @file
+/// @brief Native test of the direct chunk writes of AppendCompoundRows()
+///
+/// Appends the same rows in batches of varying size to a compound dataset
+/// written with direct chunk writes and to one written through the HDF5
+/// filter pipeline, as with IPNWB_Configure /DIRECT=0. Both are read back
+/// through HDF5 and compared row by row with each other and with the input,
+/// for 32bit and 64bit members, with and without shuffle and deflate, with
+/// the chunks compressed on the calling thread and on worker threads.
+///
+/// Usage: test_direct_chunks [--dir tmpdir]
+
+#include "CompoundEngine.h"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+using namespace fmt::literals;
+using namespace CompoundEngine;
+
+static const std::size_t NUM_ROWS   = 1000;
+static const hsize_t CHUNK_SIZE     = 64;
+static const std::size_t NUM_GROUPS = 5;
+
+// batches start and end inside chunks, fill several chunks at once or fill a chunk exactly
+static const std::vector<std::size_t> BATCH_ROWS = {1, 10, 53, 64, 200, 7, 130, 535};
+
+/// Rows of one test case, offsets and sizes in 32bit or 64bit columns
+struct TestRows
+{
+  std::vector<int32_t> offsets32;
+  std::vector<int32_t> sizes32;
+  std::vector<int64_t> offsets64;
+  std::vector<int64_t> sizes64;
+  std::vector<std::string> paths;
+  std::vector<std::string_view> refs;
+  bool is64Bit = false;
+
+  /// Return rows [first, first + count)
+  CompoundRows Get(std::size_t first, std::size_t count) const
+  {
+    CompoundRows rows;
+    rows.numRows = count;
+    if(is64Bit)
+    {
+      rows.offsets = {offsets64.data() + first, true};
+      rows.sizes   = {sizes64.data() + first, true};
+    }
+    else
+    {
+      rows.offsets = {offsets32.data() + first, false};
+      rows.sizes   = {sizes32.data() + first, false};
+    }
+    rows.refs.assign(refs.begin() + first, refs.begin() + first + count);
+
+    return rows;
+  }
+};
+
+/// Return the rows, 64bit rows have values outside the 32bit range
+TestRows MakeRows(bool is64Bit)
+{
+  TestRows rows;
+  rows.is64Bit = is64Bit;
+
+  for(std::size_t i = 0; i < NUM_ROWS; i++)
+  {
+    const int64_t offset = -static_cast<int64_t>(i) * 1000 - 7;
+    const int64_t size   = static_cast<int64_t>(i % 97) * 10 + 1;
+    rows.offsets32.push_back(static_cast<int32_t>(offset));
+    rows.sizes32.push_back(static_cast<int32_t>(size));
+    rows.offsets64.push_back(offset * 10000000);
+    rows.sizes64.push_back(size + (int64_t(1) << 40));
+    rows.paths.push_back("/acquisition/ts{}"_format(i % NUM_GROUPS));
+  }
+  rows.refs.assign(rows.paths.begin(), rows.paths.end());
+
+  return rows;
+}
+
+/// Append all rows in batches of BATCH_ROWS
+void AppendAll(const H5::H5File &file, const std::string &path, const TestRows &rows, const CreationOptions &options,
+               Stats &stats)
+{
+  std::size_t first = 0;
+  for(std::size_t i = 0; first < NUM_ROWS; i++)
+  {
+    const auto count = std::min(BATCH_ROWS[i % BATCH_ROWS.size()], NUM_ROWS - first);
+    AppendRows(file, path, options, rows.Get(first, count), true, stats);
+    first += count;
+  }
+}
+
+/// Rows read back through HDF5
+struct ReadBack
+{
+  bool is64Bit = false;
+  std::vector<int64_t> offsets;
+  std::vector<int64_t> sizes;
+  std::vector<std::string> paths;
+};
+
+ReadBack ReadAll(const H5::H5File &file, const std::string &path)
+{
+  ReadBack result;
+  H5::DataSet dataSet = OpenCompound(file, path, result.is64Bit);
+
+  const auto numRows = GetNumRows(dataSet);
+  if(numRows != NUM_ROWS)
+  {
+    throw std::runtime_error("{} has {} rows instead of {}."_format(path, numRows, NUM_ROWS));
+  }
+
+  result.offsets.resize(numRows);
+  result.sizes.resize(numRows);
+  ReadIntMember(dataSet, {result.offsets.data(), true}, MEMBERNAME_START, 0, numRows);
+  ReadIntMember(dataSet, {result.sizes.data(), true}, MEMBERNAME_COUNT, 0, numRows);
+
+  DereferenceCache cache;
+  result.paths = ResolveReferences(file, ReadReferences(dataSet, 0, numRows), cache, false).paths;
+
+  return result;
+}
+
+/// Compare the dataset written with direct chunk writes with the one written through HDF5 and the input
+void Compare(const std::string &name, const ReadBack &direct, const ReadBack &filtered, const TestRows &rows)
+{
+  if(direct.is64Bit != rows.is64Bit || filtered.is64Bit != rows.is64Bit)
+  {
+    throw std::runtime_error("{}: the datasets do not have {}bit members."_format(name, rows.is64Bit ? 64 : 32));
+  }
+
+  for(std::size_t i = 0; i < NUM_ROWS; i++)
+  {
+    const int64_t offset = rows.is64Bit ? rows.offsets64[i] : rows.offsets32[i];
+    const int64_t size   = rows.is64Bit ? rows.sizes64[i] : rows.sizes32[i];
+
+    if(direct.offsets[i] != filtered.offsets[i] || direct.sizes[i] != filtered.sizes[i] ||
+       direct.paths[i] != filtered.paths[i])
+    {
+      throw std::runtime_error("{}: row {} differs, direct ({}, {}, {}), filtered ({}, {}, {})."_format(
+          name, i, direct.offsets[i], direct.sizes[i], direct.paths[i], filtered.offsets[i], filtered.sizes[i],
+          filtered.paths[i]));
+    }
+
+    if(direct.offsets[i] != offset || direct.sizes[i] != size || direct.paths[i] != rows.paths[i])
+    {
+      throw std::runtime_error("{}: row {} is ({}, {}, {}) instead of ({}, {}, {})."_format(
+          name, i, direct.offsets[i], direct.sizes[i], direct.paths[i], offset, size, rows.paths[i]));
+    }
+  }
+}
+
+/// Run one case, return the name of the case
+std::string RunCase(const std::string &dir, bool is64Bit, bool shuffle, int deflateLevel, unsigned int numThreads)
+{
+  const auto name = "{}bit shuffle={} deflate={} threads={}"_format(is64Bit ? 64 : 32, shuffle, deflateLevel,
+                                                                   numThreads);
+
+  const auto fileName = "{}/test_direct_chunks.h5"_format(dir);
+  H5::H5File file(fileName, H5F_ACC_TRUNC);
+  file.createGroup("/acquisition");
+  for(std::size_t i = 0; i < NUM_GROUPS; i++)
+  {
+    file.createGroup("/acquisition/ts{}"_format(i));
+  }
+
+  CreationOptions options;
+  options.chunkSize    = CHUNK_SIZE;
+  options.shuffle      = shuffle;
+  options.deflateLevel = deflateLevel;
+  options.numThreads   = numThreads;
+
+  const auto rows = MakeRows(is64Bit);
+
+  Stats directStats;
+  options.directChunks = true;
+  AppendAll(file, "/direct", rows, options, directStats);
+
+  Stats filteredStats;
+  options.directChunks = false;
+  AppendAll(file, "/filtered", rows, options, filteredStats);
+
+  // the batches fill most chunks, except the ones they start or end in
+  if(directStats.Get(Stats::Phase::WriteCompoundChunks).rows == 0)
+  {
+    throw std::runtime_error("{}: no chunks were written directly."_format(name));
+  }
+  if(filteredStats.Get(Stats::Phase::WriteCompoundChunks).rows != 0)
+  {
+    throw std::runtime_error("{}: chunks were written directly although disabled."_format(name));
+  }
+
+  // read back from a file opened anew, nothing is served from the chunk cache
+  file.close();
+  H5::H5File readFile(fileName, H5F_ACC_RDONLY);
+  Compare(name, ReadAll(readFile, "/direct"), ReadAll(readFile, "/filtered"), rows);
+
+  return name;
+}
+
+} // anonymous namespace
+
+int main(int argc, char **argv)
+{
+  std::string dir = ".";
+  for(int i = 1; i < argc; i++)
+  {
+    const std::string arg = argv[i];
+    if(arg == "--dir" && i + 1 < argc)
+    {
+      dir = argv[++i];
+      continue;
+    }
+
+    std::fprintf(stderr, "Unknown argument %s\n", arg.c_str());
+    return 1;
+  }
+
+  try
+  {
+    // errors are reported with exceptions
+    H5::Exception::dontPrint();
+
+    for(bool is64Bit : {false, true})
+    {
+      for(bool shuffle : {false, true})
+      {
+        for(int deflateLevel : {-1, 1, 6})
+        {
+          for(unsigned int numThreads : {0u, 3u})
+          {
+            std::fprintf(stderr, "%s: ok\n", RunCase(dir, is64Bit, shuffle, deflateLevel, numThreads).c_str());
+          }
+        }
+      }
+    }
+  }
+  catch(H5::Exception const &ex)
+  {
+    std::fprintf(stderr, "HDF5 error: %s\n", ex.getCDetailMsg());
+    return 1;
+  }
+  catch(std::exception const &ex)
+  {
+    std::fprintf(stderr, "Error: %s\n", ex.what());
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,327 @@
+/// @file
+/// @brief Generate NWB files with epochs tables shaped like MIES output
+///
+/// Every sweep has an acquired timeseries below /acquisition and a stimulus
+/// timeseries below /stimulus/presentation. The epochs are spread evenly over
+/// the sweeps, each covers a range of its sweep and references both of its
+/// timeseries, like the epochs MIES writes. The epochs table is written with
+/// the schema code of the XOP, so the files can be read with IPNWB_ReadCompound.
+///
+/// Usage: generate_nwb --output file.h5 [--timeseries 100] [--rows 10000] [--samples 10000]
+///                     [--chunk 0] [--deflate -1] [--shuffle] [--wide]
+///                     [--libver earliest|v18|v110|latest] [--seed 1]
+
+#include "CompoundEngine.h"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+using namespace fmt::literals;
+using namespace CompoundEngine;
+
+static const std::string EPOCHS_PATH = "/intervals/epochs";
+
+// epochs are written in batches of this many rows to bound the memory use
+static const std::size_t BATCH_ROWS = 65536;
+
+// sampling rate of the timeseries in Hz
+static const double SAMPLING_RATE = 50000;
+
+struct Options
+{
+  std::string output;
+  std::size_t numTimeSeries = 100; ///< number of sweeps, each has an acquired and a stimulus timeseries
+  std::size_t numRows       = 10000;
+  std::size_t numSamples    = 10000; ///< samples per timeseries, 0 creates no data
+  H5F_libver_t libver       = H5F_LIBVER_EARLIEST;
+  unsigned int seed         = 1;
+  CreationOptions creation;
+};
+
+H5F_libver_t ParseLibver(const std::string &value)
+{
+  if(value == "earliest")
+  {
+    return H5F_LIBVER_EARLIEST;
+  }
+  if(value == "v18")
+  {
+    return H5F_LIBVER_V18;
+  }
+  if(value == "v110")
+  {
+    return H5F_LIBVER_V110;
+  }
+  if(value == "latest")
+  {
+    return H5F_LIBVER_LATEST;
+  }
+
+  throw std::runtime_error("Unknown format version {}, use earliest, v18, v110 or latest."_format(value));
+}
+
+Options ParseOptions(int argc, char **argv)
+{
+  Options options;
+
+  for(int i = 1; i < argc; i++)
+  {
+    const std::string arg = argv[i];
+
+    if(arg == "--shuffle")
+    {
+      options.creation.shuffle = true;
+      continue;
+    }
+    if(arg == "--wide")
+    {
+      options.creation.wideIndices = true;
+      continue;
+    }
+
+    if(i + 1 >= argc)
+    {
+      throw std::runtime_error("Missing value for {}."_format(arg));
+    }
+    const std::string value = argv[++i];
+
+    if(arg == "--output")
+    {
+      options.output = value;
+    }
+    else if(arg == "--timeseries")
+    {
+      options.numTimeSeries = std::max<std::size_t>(1, std::stoull(value));
+    }
+    else if(arg == "--rows")
+    {
+      options.numRows = std::stoull(value);
+    }
+    else if(arg == "--samples")
+    {
+      options.numSamples = std::stoull(value);
+    }
+    else if(arg == "--chunk")
+    {
+      options.creation.chunkSize = std::stoull(value);
+    }
+    else if(arg == "--deflate")
+    {
+      options.creation.deflateLevel = std::stoi(value);
+      if(options.creation.deflateLevel < -1 || options.creation.deflateLevel > 9)
+      {
+        throw std::runtime_error("--deflate must be between -1 and 9.");
+      }
+    }
+    else if(arg == "--libver")
+    {
+      options.libver = ParseLibver(value);
+    }
+    else if(arg == "--seed")
+    {
+      options.seed = static_cast<unsigned int>(std::stoul(value));
+    }
+    else
+    {
+      throw std::runtime_error("Unknown option {}."_format(arg));
+    }
+  }
+
+  if(options.output.empty())
+  {
+    throw std::runtime_error("--output is required.");
+  }
+
+  return options;
+}
+
+std::string GetAcquisitionPath(std::size_t sweep)
+{
+  return "/acquisition/data_{:05}_AD0"_format(sweep);
+}
+
+std::string GetStimulusPath(std::size_t sweep)
+{
+  return "/stimulus/presentation/data_{:05}_DA0"_format(sweep);
+}
+
+/// Create the timeseries groups of all sweeps, with `numSamples` samples of data each
+void CreateTimeSeries(const H5::H5File &file, const Options &options)
+{
+  for(const auto &path : {"/acquisition", "/stimulus", "/stimulus/presentation", "/intervals", EPOCHS_PATH.c_str()})
+  {
+    file.createGroup(path);
+  }
+
+  std::vector<float> data(options.numSamples);
+  for(std::size_t i = 0; i < data.size(); i++)
+  {
+    data[i] = static_cast<float>(i % 1000) * 1e-3f;
+  }
+
+  for(std::size_t sweep = 0; sweep < options.numTimeSeries; sweep++)
+  {
+    for(const auto &path : {GetAcquisitionPath(sweep), GetStimulusPath(sweep)})
+    {
+      H5::Group group = file.createGroup(path);
+      if(data.empty())
+      {
+        continue;
+      }
+
+      hsize_t numSamples = data.size();
+      H5::DataSpace dataSpace(1, &numSamples);
+      group.createDataSet("data", H5::PredType::IEEE_F32LE, dataSpace)
+          .write(data.data(), H5::PredType::NATIVE_FLOAT);
+    }
+  }
+}
+
+/// Epochs of one batch, in the layout of the columns of the epochs table
+struct EpochsBatch
+{
+  std::vector<double> startTimes;
+  std::vector<double> stopTimes;
+  std::vector<std::string> tags;
+  std::vector<int64_t> tagsIndex;
+  std::vector<int64_t> offsets;
+  std::vector<int64_t> sizes;
+  std::vector<std::string_view> refs;
+  std::vector<int64_t> timeSeriesIndex;
+  std::vector<int32_t> treeLevels;
+  std::vector<int64_t> ids;
+};
+
+/// Write the epochs table, the epochs are spread evenly over the sweeps
+void WriteEpochs(const H5::H5File &file, const Options &options)
+{
+  H5::Group table = file.openGroup(EPOCHS_PATH);
+
+  std::vector<std::string> acquisitionPaths, stimulusPaths;
+  for(std::size_t sweep = 0; sweep < options.numTimeSeries; sweep++)
+  {
+    acquisitionPaths.push_back(GetAcquisitionPath(sweep));
+    stimulusPaths.push_back(GetStimulusPath(sweep));
+  }
+
+  std::mt19937 engine(options.seed);
+  std::uniform_int_distribution<int32_t> treeLevelDist(0, 4);
+  const auto samplesPerSweep = std::max<std::size_t>(options.numSamples, 2);
+  const double sweepLength   = static_cast<double>(samplesPerSweep) / SAMPLING_RATE;
+
+  // the Igor side creates these columns as 32bit signed integers
+  const auto indexType  = H5::PredType::STD_I32LE;
+  const auto int64Type  = H5::PredType::NATIVE_INT64;
+  const auto doubleType = H5::PredType::IEEE_F64LE;
+  H5::StrType tagsType(H5::PredType::C_S1, H5T_VARIABLE);
+  tagsType.setCset(H5T_CSET_UTF8);
+
+  for(std::size_t first = 0; first < options.numRows; first += BATCH_ROWS)
+  {
+    const auto count = std::min(BATCH_ROWS, options.numRows - first);
+
+    EpochsBatch batch;
+    for(std::size_t row = first; row < first + count; row++)
+    {
+      const auto sweep = row * options.numTimeSeries / std::max<std::size_t>(options.numRows, 1);
+
+      std::uniform_int_distribution<int64_t> offsetDist(0, static_cast<int64_t>(samplesPerSweep) - 2);
+      const auto offset = offsetDist(engine);
+      std::uniform_int_distribution<int64_t> sizeDist(1, static_cast<int64_t>(samplesPerSweep) - offset);
+      const auto size      = sizeDist(engine);
+      const auto treeLevel = treeLevelDist(engine);
+
+      const double sweepStart = static_cast<double>(sweep) * sweepLength;
+      batch.startTimes.push_back(sweepStart + static_cast<double>(offset) / SAMPLING_RATE);
+      batch.stopTimes.push_back(sweepStart + static_cast<double>(offset + size) / SAMPLING_RATE);
+      batch.tags.push_back("Type=Epoch;TreeLevel={};ShortName=E{}_S{};"_format(treeLevel, row, sweep));
+      batch.tagsIndex.push_back(static_cast<int64_t>(row + 1));
+
+      // both timeseries of the sweep cover the same range
+      for(const auto *paths : {&acquisitionPaths, &stimulusPaths})
+      {
+        batch.offsets.push_back(offset);
+        batch.sizes.push_back(size);
+        batch.refs.push_back((*paths)[sweep]);
+      }
+      batch.timeSeriesIndex.push_back(static_cast<int64_t>(2 * (row + 1)));
+      batch.treeLevels.push_back(treeLevel);
+      batch.ids.push_back(static_cast<int64_t>(row));
+    }
+
+    std::vector<const char *> tagPointers;
+    for(const auto &tag : batch.tags)
+    {
+      tagPointers.push_back(tag.c_str());
+    }
+
+    CompoundRows rows;
+    rows.numRows = batch.refs.size();
+    rows.offsets = {batch.offsets.data(), true};
+    rows.sizes   = {batch.sizes.data(), true};
+    rows.refs    = batch.refs;
+
+    // same column order as IPNWB_WriteEpochs, id last as it defines the number of rows
+    const auto &creation = options.creation;
+    AppendToDataSet(table, COLUMN_START_TIME, H5::PredType::NATIVE_DOUBLE, doubleType, batch.startTimes.data(), count,
+                    creation);
+    AppendToDataSet(table, COLUMN_STOP_TIME, H5::PredType::NATIVE_DOUBLE, doubleType, batch.stopTimes.data(), count,
+                    creation);
+    AppendToDataSet(table, COLUMN_TAGS, tagsType, tagsType, tagPointers.data(), count, creation);
+    AppendToDataSet(table, COLUMN_TAGS_INDEX, int64Type, indexType, batch.tagsIndex.data(), count, creation);
+
+    Stats stats;
+    AppendRows(file, EPOCHS_PATH + "/" + COLUMN_TIMESERIES, creation, rows, true, stats);
+
+    AppendToDataSet(table, COLUMN_TIMESERIES_INDEX, int64Type, indexType, batch.timeSeriesIndex.data(), count,
+                    creation);
+    AppendToDataSet(table, COLUMN_TREELEVEL, H5::PredType::NATIVE_INT32, indexType, batch.treeLevels.data(), count,
+                    creation);
+    AppendToDataSet(table, COLUMN_ID, int64Type, indexType, batch.ids.data(), count, creation);
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  try
+  {
+    const auto options = ParseOptions(argc, argv);
+
+    // errors are reported with exceptions
+    H5::Exception::dontPrint();
+
+    H5::FileAccPropList accessPropList;
+    accessPropList.setLibverBounds(options.libver, H5F_LIBVER_LATEST);
+
+    H5::H5File file(options.output, H5F_ACC_TRUNC, H5::FileCreatPropList::DEFAULT, accessPropList);
+    CreateTimeSeries(file, options);
+    WriteEpochs(file, options);
+
+    std::fprintf(stderr, "Wrote %zu epochs referencing %zu timeseries to %s\n", options.numRows,
+                 2 * options.numTimeSeries, options.output.c_str());
+  }
+  catch(const H5::Exception &e)
+  {
+    std::fprintf(stderr, "HDF5 error: %s\n", e.getCDetailMsg());
+    return EXIT_FAILURE;
+  }
+  catch(const std::exception &e)
+  {
+    std::fprintf(stderr, "Error: %s\n", e.what());
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1 @@
+WAVE IPNWB_GetStats();